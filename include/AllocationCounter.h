@@ -0,0 +1,18 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+// Debug hook that counts heap allocations per thread, to check that code meant to be
+// allocation-free in steady state really is. Counting replaces every form of the global operator
+// new, so it's only compiled in with the OPENGLED_COUNT_ALLOCATIONS CMake option; otherwise
+// enabled() is false and the counts stay at 0. Binaries linked with --wrap for malloc, calloc and
+// realloc and built with OPENGLED_WRAP_MALLOC count those calls too, as the allocation test does.
+class AllocationCounter
+{
+public:
+    static bool enabled();
+
+    // operator new (and wrapped malloc) calls made so far on the calling thread
+    static unsigned long allocations_on_this_thread();
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef AUDIO_ANALYZER_H
+#define AUDIO_ANALYZER_H
+
+#include <vector>
+
+#include "Iir.h"
+
+#include "BandFilter.h"
+#include "CircularBuffer.h"
+#include "OpenGLEDConfig.h"
+
+#define FILTER_ORDER 2
+
+// Splits each block of captured audio into frequency bands and keeps a history of each band's
+// level for the audio texture. Every analysis channel gets its own band bank, and its rows come
+// after the previous channel's in the texture: row = channel * num_bands + band. Channels are
+// filtered in pairs through the same BandFilter, so a stereo bank costs about as much as mono.
+//
+// Audio is analysed in batches of up to max_backlog_blocks blocks, so catching up on a backlog
+// is one pass over each band instead of the whole per-block path again and again. All the
+// buffers are sized for the largest batch up front, nothing is allocated while running.
+class AudioAnalyzer
+{
+private:
+    int input_channels, analysis_channels, num_bands;
+    int samples_per_pixel, pixels_per_band, history_length, max_blocks;
+    ChannelMix channel_mix;
+    bool decimate = false;
+
+    Iir::Butterworth::BandPass<FILTER_ORDER> design;                    // only used to work out coefficients
+    std::vector<BandFilter> band_filters;                               // one per channel pair and band: pair * num_bands + band
+    std::vector<BandFilter> decimated_filters;                          // same bands designed at half the sample rate
+    std::vector<bool> band_decimatable;                                 // whether a band fits under a quarter of the sample rate
+    std::vector<float> decimated_samples;                               // pair averages of a channel pair, whole batch
+    std::vector<std::vector<float>> input_samples;                      // deinterleaved input channels, whole batch
+    std::vector<std::vector<float>> analysis_samples;                   // after the channel mix, whole batch
+    std::vector<float*> input_pointers;
+    std::vector<CircularBuffer<unsigned char>> band_pixel_buffers;      // one per row
+    std::vector<unsigned char> texture_data;
+    std::vector<float> levels;                                          // latest level of each row
+    std::vector<float> block_means;                                     // level of each band averaged over channels, for each block of the batch
+
+public:
+    float pregain;
+
+    AudioAnalyzer(OpenGLEDConfig& config);
+
+    // (Re)design the band filters, e.g. after the cutoffs change
+    void setup_filters(OpenGLEDConfig& config);
+
+    // Cheaper analysis for when the frame budget is tight: bands that fit under a quarter of the
+    // sample rate are filtered at half the rate, on averaged pairs of samples
+    void set_decimation(bool decimate);
+
+    // How many of the newest pixels of each row go in the texture, up to pixels_per_band
+    void set_history_length(int history_length);
+    int history() const { return history_length; }
+
+    // Analyse a batch of blocks (at most max_batch_blocks()) of samples_per_pixel interleaved S16_LE
+    // frames, pushing one pixel per block onto each row's history. If band_debug_out isn't null,
+    // each row's filtered samples are also written to band_debug_out[row].
+    void process_batch(const char* interleaved, int blocks, float* const* band_debug_out = nullptr);
+
+    // Copy the newest history() pixels of each row into the texture, once all the batches for a frame are in
+    void update_texture();
+
+    int max_batch_blocks() const { return max_blocks; }
+
+    int rows() const { return analysis_channels * num_bands; }
+    int channel_pairs() const { return (analysis_channels + 1) / 2; }
+    int channels() const { return analysis_channels; }
+    // Samples of an analysis channel from the last batch, after the channel mix
+    const float* samples(int channel) const { return (channel_mix == ChannelMix::Separate ? input_samples : analysis_samples)[channel].data(); }
+    const std::vector<float>& band_levels() const { return levels; }
+    // num_bands levels of a block in the last batch, averaged over channels
+    const float* band_levels_over_channels(int block) const { return block_means.data() + block * num_bands; }
+
+    // history() x rows of GL_LUMINANCE bytes
+    const unsigned char* texture() const { return texture_data.data(); }
+};
+
+#endif
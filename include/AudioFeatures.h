@@ -0,0 +1,72 @@
+#ifndef AUDIO_FEATURES_H
+#define AUDIO_FEATURES_H
+
+#include <vector>
+
+#include <GLES2/gl2.h>
+
+#include "CircularBuffer.h"
+#include "OpenGLEDConfig.h"
+
+// Size of the per-band uniform arrays, bands past this are left out of the features
+#define MAX_AUDIO_FEATURE_BANDS 8
+
+// Per-frame audio features computed once per audio block on the CPU, so shaders can read them
+// as uniforms instead of sampling audioTexture at a fixed coordinate for every LED:
+//
+//   uniform float audioLevel[8];   // current level of each band, 0 - 1
+//   uniform float audioPeak[8];    // peak-hold of each band, 0 - 1
+//   uniform float audioOnset[8];   // 1.0 if the band had an onset since the last frame
+//   uniform float audioBeat;       // 1.0 if the lowest band had a beat since the last frame
+//   uniform float audioBeatPhase;  // 0 at a beat, ramps to 1 at the next expected beat
+//   uniform float audioBpm;        // tempo estimate, 0 until a few beats have been heard
+//   uniform float audioCentroid;   // spectral centroid, 0 - 1 on a log scale between the band cutoffs
+//   uniform float audioBands;      // bands per channel in audioTexture
+//   uniform float audioChannels;   // analysed channels in audioTexture, row = channel * audioBands + band
+class AudioFeatureExtractor
+{
+private:
+    int num_bands;
+    int texture_bands, texture_channels;
+    float blocks_per_second;
+    std::vector<float> log_center_frequencies;
+    float log_lowest_frequency, log_highest_frequency;
+
+    float levels[MAX_AUDIO_FEATURE_BANDS] = {};
+    float peaks[MAX_AUDIO_FEATURE_BANDS] = {};
+    int peak_ages[MAX_AUDIO_FEATURE_BANDS] = {}; // blocks since each peak was set
+    float averages[MAX_AUDIO_FEATURE_BANDS] = {};
+    bool averages_seeded[MAX_AUDIO_FEATURE_BANDS] = {}; // set from the first block with sound in it
+    int blocks_since_onset[MAX_AUDIO_FEATURE_BANDS] = {};
+    float onsets[MAX_AUDIO_FEATURE_BANDS] = {};  // latched until the next upload
+
+    float beat = 0, bpm = 0, centroid = 0;
+    long blocks_processed = 0, last_beat_block = -1;
+    CircularBuffer<float> beat_intervals;        // seconds between recent beats
+
+    struct UniformLocations
+    {
+        GLuint program;
+        GLint level, peak, onset, beat, beat_phase, bpm, centroid;
+        GLint bands, channels;
+    };
+    std::vector<UniformLocations> programs;
+
+    const UniformLocations& locations_for(GLuint program);
+    void update_bpm(float interval);
+
+public:
+    AudioFeatureExtractor(OpenGLEDConfig& config);
+
+    // band_levels holds one level (0 - 1) per band for the block that was just analysed
+    void process_block(const float* band_levels);
+
+    bool beat_since_upload() const { return beat > 0; }
+
+    // Set the feature uniforms on the program currently in use, and clear the latched flags. Only
+    // that program gets them: the render loop calls this every frame with whichever program it's
+    // about to draw with, so a program that's switched to picks them up on its first frame.
+    void upload(GLuint program);
+};
+
+#endif
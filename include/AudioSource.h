@@ -0,0 +1,85 @@
+#ifndef AUDIO_SOURCE_H
+#define AUDIO_SOURCE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include "ALSADevices.hpp"
+
+// Where the render loop gets S16_LE audio from. Besides the samples, every source knows when
+// the last sample it handed out was captured (CLOCK_MONOTONIC), so that time can be carried
+// through to the frame that first shows it.
+class AudioSource
+{
+public:
+    // False if the source can't be opened, e.g. the ALSA device doesn't exist or is busy
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual long samples_left_to_read() = 0;
+    virtual void capture_into_buffer(char* buffer, int frames) = 0;
+    virtual int bytes_per_frame() = 0;
+    // When the last sample returned by capture_into_buffer was captured
+    virtual timespec capture_timestamp() = 0;
+
+    virtual ~AudioSource() {}
+};
+
+// Capture device with ALSA's monotonic high resolution timestamps turned on, so
+// snd_pcm_status can tell when the samples we read were actually captured
+class TimestampedCaptureDevice : public ALSACaptureDevice
+{
+public:
+    using ALSACaptureDevice::ALSACaptureDevice;
+
+    bool enable_timestamps();
+    // Capture time of the sample frames_still_buffered before the newest one
+    bool timestamp_of_sample(long* frames_still_buffered, timespec* captured);
+};
+
+class ALSAAudioSource : public AudioSource
+{
+private:
+    TimestampedCaptureDevice device;
+    int sample_rate;
+    timespec last_capture = {};
+
+public:
+    ALSAAudioSource(std::string device_name, int sample_rate, int channels, int frames_per_period);
+
+    bool open() override;
+    void close() override;
+    long samples_left_to_read() override { return device.samples_left_to_read(); }
+    void capture_into_buffer(char* buffer, int frames) override;
+    int bytes_per_frame() override { return device.get_bytes_per_frame(); }
+    timespec capture_timestamp() override { return last_capture; }
+};
+
+// Synthetic source for measuring latency without a mic: silence with a short low frequency
+// burst every click_interval seconds, produced in real time off CLOCK_MONOTONIC.
+class ClickAudioSource : public AudioSource
+{
+private:
+    int sample_rate, channels;
+    long click_interval_samples, click_length_samples;
+    timespec started = {};
+    long samples_produced = 0;
+
+    timespec time_of_sample(long sample);
+
+public:
+    ClickAudioSource(int sample_rate, int channels, float click_interval = 0.5f);
+
+    bool open() override;
+    void close() override {}
+    long samples_left_to_read() override;
+    void capture_into_buffer(char* buffer, int frames) override;
+    int bytes_per_frame() override { return channels * 2; }
+    timespec capture_timestamp() override { return time_of_sample(samples_produced - 1); }
+
+    // When the first sample of the most recent click was produced
+    timespec last_click_timestamp();
+};
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef BAND_FILTER_H
+#define BAND_FILTER_H
+
+#include <algorithm>
+#include <math.h>
+
+#define BAND_FILTER_MAX_STAGES 4
+
+// One band's biquad cascade. iir1 designs it, but the filtering happens here so two channels can
+// run through the same coefficients in lockstep. A sample costs the latency of each stage's
+// feedback, not its arithmetic, so two independent channels fit in the gaps and stereo costs
+// little more than mono instead of twice. The stage count is a template parameter so the state
+// of every stage stays in registers for the whole block.
+class BandFilter
+{
+private:
+    int num_stages = 0;
+    double b0[BAND_FILTER_MAX_STAGES], b1[BAND_FILTER_MAX_STAGES], b2[BAND_FILTER_MAX_STAGES]; // normalized by a0
+    double a1[BAND_FILTER_MAX_STAGES], a2[BAND_FILTER_MAX_STAGES];
+    double w1[BAND_FILTER_MAX_STAGES][2] = {}, w2[BAND_FILTER_MAX_STAGES][2] = {};              // direct form II state of each lane
+
+    // State decays towards 0 in silence, don't let it go denormal and slow every sample down
+    void flush_denormals()
+    {
+        for(int s = 0; s < num_stages; s++){
+            for(int lane = 0; lane < 2; lane++){
+                if(fabs(w1[s][lane]) < 1e-30) w1[s][lane] = 0;
+                if(fabs(w2[s][lane]) < 1e-30) w2[s][lane] = 0;
+            }
+        }
+    }
+
+    template <int STAGES>
+    double filter_stages(const float* in, int count, float* out)
+    {
+        double s1[STAGES], s2[STAGES];
+        for(int s = 0; s < STAGES; s++){
+            s1[s] = w1[s][0];
+            s2[s] = w2[s][0];
+        }
+
+        double sum = 0;
+        for(int i = 0; i < count; i++){
+            double x = in[i];
+            for(int s = 0; s < STAGES; s++){
+                double w = x - a1[s] * s1[s] - a2[s] * s2[s];
+                x = b0[s] * w + b1[s] * s1[s] + b2[s] * s2[s];
+                s2[s] = s1[s];
+                s1[s] = w;
+            }
+            if(out) out[i] = x;
+            sum += x * x;
+        }
+
+        for(int s = 0; s < STAGES; s++){
+            w1[s][0] = s1[s];
+            w2[s][0] = s2[s];
+        }
+        return sum;
+    }
+
+#if defined(__arm__) || defined(__aarch64__)
+    // Both lanes as scalar chains interleaved in one loop. ARMv7 NEON has no double lanes, and
+    // the Pi 4's Cortex-A72 splits 2-lane double NEON ops in two, so plain scalar code is what
+    // fills the latency gaps on every Pi, the in-order Cortex-A53 included.
+    template <int STAGES>
+    void filter_pair_stages(const float* in0, const float* in1, int count, double* sum0, double* sum1, float* out0, float* out1)
+    {
+        double p1[STAGES], p2[STAGES], q1[STAGES], q2[STAGES]; // lane 0 and lane 1 state
+        for(int s = 0; s < STAGES; s++){
+            p1[s] = w1[s][0];
+            p2[s] = w2[s][0];
+            q1[s] = w1[s][1];
+            q2[s] = w2[s][1];
+        }
+
+        double sum_p = 0, sum_q = 0;
+        for(int i = 0; i < count; i++){
+            double x = in0[i], y = in1[i];
+            for(int s = 0; s < STAGES; s++){
+                double wx = x - a1[s] * p1[s] - a2[s] * p2[s];
+                double wy = y - a1[s] * q1[s] - a2[s] * q2[s];
+                x = b0[s] * wx + b1[s] * p1[s] + b2[s] * p2[s];
+                y = b0[s] * wy + b1[s] * q1[s] + b2[s] * q2[s];
+                p2[s] = p1[s];
+                p1[s] = wx;
+                q2[s] = q1[s];
+                q1[s] = wy;
+            }
+            if(out0){
+                out0[i] = x;
+                out1[i] = y;
+            }
+            sum_p += x * x;
+            sum_q += y * y;
+        }
+
+        for(int s = 0; s < STAGES; s++){
+            w1[s][0] = p1[s];
+            w2[s][0] = p2[s];
+            w1[s][1] = q1[s];
+            w2[s][1] = q2[s];
+        }
+        *sum0 = sum_p;
+        *sum1 = sum_q;
+    }
+#else
+    // Both lanes in one vector the compiler maps to the target's SIMD, SSE2 on x86
+    template <int STAGES>
+    void filter_pair_stages(const float* in0, const float* in1, int count, double* sum0, double* sum1, float* out0, float* out1)
+    {
+        typedef double double2 __attribute__((vector_size(16)));
+        double2 s1[STAGES], s2[STAGES];
+        for(int s = 0; s < STAGES; s++){
+            s1[s] = (double2) {w1[s][0], w1[s][1]};
+            s2[s] = (double2) {w2[s][0], w2[s][1]};
+        }
+
+        double2 sums = {0, 0};
+        for(int i = 0; i < count; i++){
+            double2 x = {in0[i], in1[i]};
+            for(int s = 0; s < STAGES; s++){
+                double2 w = x - a1[s] * s1[s] - a2[s] * s2[s];
+                x = b0[s] * w + b1[s] * s1[s] + b2[s] * s2[s];
+                s2[s] = s1[s];
+                s1[s] = w;
+            }
+            if(out0){
+                out0[i] = x[0];
+                out1[i] = x[1];
+            }
+            sums += x * x;
+        }
+
+        for(int s = 0; s < STAGES; s++){
+            w1[s][0] = s1[s][0];
+            w1[s][1] = s1[s][1];
+            w2[s][0] = s2[s][0];
+            w2[s][1] = s2[s][1];
+        }
+        *sum0 = sums[0];
+        *sum1 = sums[1];
+    }
+#endif
+
+public:
+    // Takes the coefficients of an iir1 filter that's already set up, keeps the current state
+    template <class Design>
+    void setup(Design& design)
+    {
+        num_stages = std::min(design.getNumStages(), BAND_FILTER_MAX_STAGES);
+        for(int s = 0; s < num_stages; s++){
+            const auto& stage = design[s];
+            double a0 = stage.getA0();
+            b0[s] = stage.getB0() / a0;
+            b1[s] = stage.getB1() / a0;
+            b2[s] = stage.getB2() / a0;
+            a1[s] = stage.getA1() / a0;
+            a2[s] = stage.getA2() / a0;
+        }
+    }
+
+    void reset()
+    {
+        std::fill(&w1[0][0], &w1[0][0] + BAND_FILTER_MAX_STAGES * 2, 0.0);
+        std::fill(&w2[0][0], &w2[0][0] + BAND_FILTER_MAX_STAGES * 2, 0.0);
+    }
+
+    // Filters samples of one channel through lane 0 and returns the sum of squares of the output.
+    // If out isn't null the filtered samples are written to it too.
+    double filter(const float* in, int count, float* out)
+    {
+        double sum;
+        switch(num_stages){
+            case 1: sum = filter_stages<1>(in, count, out); break;
+            case 2: sum = filter_stages<2>(in, count, out); break;
+            case 3: sum = filter_stages<3>(in, count, out); break;
+            default: sum = filter_stages<4>(in, count, out); break;
+        }
+        flush_denormals();
+        return sum;
+    }
+
+    // Same for two channels at once, through lanes 0 and 1
+    void filter_pair(const float* in0, const float* in1, int count, double* sum0, double* sum1, float* out0, float* out1)
+    {
+        switch(num_stages){
+            case 1: filter_pair_stages<1>(in0, in1, count, sum0, sum1, out0, out1); break;
+            case 2: filter_pair_stages<2>(in0, in1, count, sum0, sum1, out0, out1); break;
+            case 3: filter_pair_stages<3>(in0, in1, count, sum0, sum1, out0, out1); break;
+            default: filter_pair_stages<4>(in0, in1, count, sum0, sum1, out0, out1); break;
+        }
+        flush_denormals();
+    }
+};
+
+#endif
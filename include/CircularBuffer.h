@@ -71,6 +71,19 @@ public:
         return number;
     }
 
+    // Like peek, but copies the newest number elements instead of the oldest
+    int peek_latest(T* write_to, int number){
+        if(number > size()) number = size();
+        int start = (head - number + capacity) % capacity;
+
+        int num_to_copy_first = std::min(number, capacity - start);
+        int num_to_copy_second = number - num_to_copy_first;
+        std::memcpy(write_to, buffer.data() + start, num_to_copy_first * sizeof(T));
+        if(num_to_copy_second > 0) std::memcpy(write_to + num_to_copy_first, buffer.data(), num_to_copy_second * sizeof(T));
+
+        return number;
+    }
+
     // Function to check if the buffer is empty
     bool empty() const { return head == tail; }
 
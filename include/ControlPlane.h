@@ -0,0 +1,71 @@
+#ifndef CONTROL_PLANE_H
+#define CONTROL_PLANE_H
+
+#include <atomic>
+#include <cmath>
+#include <stdint.h>
+#include <string>
+
+#define CONTROL_PLANE_MAGIC 0x4F50474C // "OPGL"
+#define CONTROL_PLANE_LAYOUT_VERSION 2
+#define CONTROL_MAX_BANDS 16
+
+// Everything that can be changed while the show is running. Plain data so it can live in
+// shared memory and be copied with one memcpy.
+struct ControlParameters
+{
+    int32_t brightness;  // 0 - 255
+    int32_t shader;      // shader index, or playlist index when playlists are configured
+    float pregain;       // gain applied to each band's RMS before it becomes a pixel
+    int32_t num_band_cutoffs;
+    float band_cutoffs[CONTROL_MAX_BANDS + 1];
+    int32_t sample_rate; // read only, set by the renderer so clients can check cutoffs against Nyquist
+};
+
+// Layout of the shared memory segment. Writers fill the slot the renderer isn't reading and then
+// bump version, so the renderer only pays for one atomic load per frame when nothing changed.
+struct ControlBlock
+{
+    uint32_t magic;
+    uint32_t layout_version;
+    std::atomic<uint64_t> version;     // slots[version % 2] holds the latest parameters
+    std::atomic<uint32_t> writer_lock; // only taken by writers, the renderer never waits on it
+    ControlParameters slots[2];
+};
+
+// A POSIX shared memory segment (e.g. /open_gled_control) holding a ControlBlock. The renderer
+// creates it with the parameters from the config, and clients like open_gled_ctl open it to
+// change them. The segment is created with mode 0660, so only the renderer's user and group
+// (owner_group if it's set) can read or change the parameters.
+class ControlPlane
+{
+private:
+    std::string name;
+    bool create;
+    std::string owner_group;
+    ControlBlock* block = nullptr;
+    uint64_t seen_version = 0;
+
+public:
+    ControlPlane(std::string name, bool create, std::string owner_group = "") : name(name), create(create), owner_group(owner_group) {}
+
+    // Creates (renderer) or opens (client) the segment. initial is only used when creating.
+    bool Initialize(const ControlParameters* initial = nullptr);
+
+    // Renderer side: copies the latest parameters into params and returns true if they changed
+    // since the last call. Never blocks; if a writer raced the copy it's picked up next frame.
+    bool poll(ControlParameters& params);
+
+    // Client side
+    ControlParameters read();
+    void publish(const ControlParameters& params);
+
+    // Anything can write the segment, so both sides check values before using them. Cutoffs have
+    // to be finite, strictly ascending, above 0 and below sample_rate / 2.
+    static bool ValidBandCutoffs(const float* cutoffs, int count, int sample_rate, std::string* error = nullptr);
+    static bool ValidPregain(float pregain) { return std::isfinite(pregain) && pregain >= 0; }
+
+    ~ControlPlane();
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <time.h>
+
+#define FRAME_EXPORT_MAGIC 0x4F50474D // "MGPO"
+#define FRAME_EXPORT_LAYOUT_VERSION 2
+
+struct FrameExportHeader
+{
+    uint32_t magic;
+    uint32_t layout_version;
+    uint32_t width, height, num_bands;
+    uint32_t slot_count;
+    uint32_t slot_stride;                  // bytes from one slot to the next, slots start right after the header
+    std::atomic<uint64_t> frames_written;  // the latest frame is in slot (frames_written - 1) % slot_count
+};
+
+// Each slot is followed by num_bands floats (band levels, 0 - 1) and then width * height LEDs as 0x00BBGGRR
+struct FrameExportSlot
+{
+    std::atomic<uint64_t> sequence; // odd while the renderer is writing the slot
+    uint64_t frame_number;
+    uint64_t timestamp_ns;          // CLOCK_MONOTONIC when the frame was sent to the strip
+    uint32_t brightness;
+    uint32_t quality_level;         // 0 is full quality, see QualityGovernor
+};
+
+// Ring of the final LED frames in a POSIX shared memory segment, so other processes can monitor,
+// record or preview the show. The renderer never waits on readers: each slot is a seqlock, and
+// readers map the segment read-only, read a slot in place and then check the sequence didn't
+// change underneath them.
+class FrameExport
+{
+private:
+    std::string name;
+    bool create;
+    uint8_t* memory = nullptr;
+    size_t memory_size = 0;
+    FrameExportHeader* header_ = nullptr;
+
+    // Layout the renderer creates the segment with
+    int width = 0, height = 0, num_bands = 0, slot_count = 0;
+    size_t slot_stride = 0;
+
+public:
+    // Renderer side, creates the segment for frames of the given size
+    FrameExport(std::string name, int width, int height, int num_bands, int slot_count);
+    // Reader side, opens an existing segment read-only
+    FrameExport(std::string name);
+
+    bool Initialize();
+
+    // Renderer side
+    void publish(const uint32_t* led_data, const float* band_levels, uint8_t brightness, int quality_level, timespec sent);
+
+    // Reader side
+    const FrameExportHeader* header() const { return header_; }
+    const FrameExportSlot* slot(uint64_t frame_number) const;
+    const float* bands(const FrameExportSlot* slot) const { return (const float*) (slot + 1); }
+    const uint32_t* leds(const FrameExportSlot* slot) const { return (const uint32_t*) (bands(slot) + header_->num_bands); }
+
+    // Returns the sequence to pass to end_read, or 0 if the slot is being written right now
+    static uint64_t begin_read(const FrameExportSlot* slot);
+    // True if nothing overwrote the slot since begin_read, i.e. what was read is valid
+    static bool end_read(const FrameExportSlot* slot, uint64_t sequence);
+
+    ~FrameExport();
+};
+
+#endif
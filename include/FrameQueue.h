@@ -0,0 +1,124 @@
+#ifndef FrameQueue_h
+#define FrameQueue_h
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+
+#include "CircularBuffer.h"
+
+// One frame read back from the GPU, waiting to be sent to the LEDs
+struct LedFrame
+{
+    std::vector<unsigned char> pixels; // RGBA, width * height * 4
+    int render_width, render_height;   // size the frame was drawn at, smaller than the layout when the quality governor steps down
+    uint8_t brightness;
+    std::vector<float> bands;          // level of each band when the frame was rendered
+    int quality_level;
+
+    // Latency measurement
+    bool has_new_audio;                // whether this is the first frame to show an audio block
+    timespec audio_captured;           // when the newest audio block in the frame was captured
+    bool shows_click;                  // loopback mode: the frame has the onset of a synthetic click
+    timespec click_captured;
+    timespec submitted;                // when the render thread handed it off
+};
+
+// Fixed pool of frames passed between the render thread and the LED output thread. The render
+// thread takes a free frame, fills it and submits it; the output thread takes submitted frames
+// in order and releases them back to the pool once they're copied into the DMA buffer. The pool
+// size is the pipeline depth, so the render thread blocks instead of running ahead of the strip.
+//
+// Each acquire can also report its wake-up latency: when the thread had to sleep for a frame,
+// the time from the other thread's notify to this one running again. That's how long the
+// scheduler took to get the thread going, which is what SCHED_FIFO is supposed to keep short.
+class FrameQueue
+{
+private:
+    struct FrameList
+    {
+        CircularBuffer<int> ids;
+        bool waiting = false;  // a thread is asleep until this list has a frame
+        bool notified = false; // a frame was already given since it went to sleep
+        timespec notified_at;  // when the first frame was given to the sleeping thread
+
+        FrameList(int depth) : ids(depth) {}
+    };
+
+    std::vector<LedFrame> frames;
+    FrameList free_frames;
+    FrameList ready_frames;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool closed = false;
+
+    LedFrame* take(FrameList& from, int64_t* wake_latency_ns)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool slept = !closed && from.ids.empty();
+        if(slept){
+            from.waiting = true;
+            from.notified = false;
+            changed.wait(lock, [&]{ return closed || !from.ids.empty(); });
+            from.waiting = false;
+        }
+        if(closed) return nullptr;
+
+        if(wake_latency_ns){
+            *wake_latency_ns = -1;
+            if(slept){
+                timespec woke;
+                clock_gettime(CLOCK_MONOTONIC, &woke);
+                *wake_latency_ns = (woke.tv_sec - from.notified_at.tv_sec) * 1000000000L + (woke.tv_nsec - from.notified_at.tv_nsec);
+            }
+        }
+        return &frames[from.ids.pop()];
+    }
+
+    void give(FrameList& to, LedFrame* frame)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            to.ids.push_back(frame - frames.data());
+            // Only the first notify of a wait counts, later ones would make the latency look shorter
+            if(to.waiting && !to.notified){
+                clock_gettime(CLOCK_MONOTONIC, &to.notified_at);
+                to.notified = true;
+            }
+        }
+        changed.notify_all();
+    }
+
+public:
+    FrameQueue(int depth, int frame_bytes, int num_bands) : frames(depth), free_frames(depth), ready_frames(depth)
+    {
+        for(int i = 0; i < depth; i++){
+            frames[i].pixels.resize(frame_bytes);
+            frames[i].bands.resize(num_bands, 0.f);
+            free_frames.ids.push_back(i);
+        }
+    }
+
+    // Blocks until a frame is free to render into, or returns nullptr once closed. If
+    // wake_latency_ns isn't null it gets the wake-up latency, or -1 if there was no need to sleep.
+    LedFrame* acquire_free(int64_t* wake_latency_ns = nullptr){ return take(free_frames, wake_latency_ns); }
+    void submit(LedFrame* frame){ give(ready_frames, frame); }
+
+    // Blocks until a rendered frame is ready to output, or returns nullptr once closed
+    LedFrame* acquire_ready(int64_t* wake_latency_ns = nullptr){ return take(ready_frames, wake_latency_ns); }
+    void release(LedFrame* frame){ give(free_frames, frame); }
+
+    // Wakes up both threads so they can exit
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        changed.notify_all();
+    }
+};
+
+#endif // FrameQueue_h
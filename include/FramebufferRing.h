@@ -0,0 +1,43 @@
+#ifndef FRAMEBUFFER_RING_H
+#define FRAMEBUFFER_RING_H
+
+#include <vector>
+
+#include <GLES2/gl2.h>
+
+// A ring of offscreen render targets so the GPU can draw frame N+1 while frame N is read back.
+// With a depth of 1 this is the old draw -> glReadPixels path.
+class FramebufferRing
+{
+private:
+    int width, height, depth;
+    int render_width, render_height;
+    std::vector<GLuint> framebuffers;
+    std::vector<GLuint> textures;
+    std::vector<int> drawn_widths, drawn_heights; // frames already in the ring keep the size they were drawn at
+    long frames_drawn = 0;
+
+public:
+    FramebufferRing(int width, int height, int depth) : width(width), height(height), depth(depth), render_width(width), render_height(height) {}
+
+    bool Initialize();
+
+    // Draw into the bottom left render_width x render_height of the targets from the next frame on,
+    // e.g. to render at a lower resolution and upscale afterwards
+    void set_render_size(int render_width, int render_height);
+
+    // Bind the next target to draw into
+    void begin_frame();
+    // Index of the target being drawn, valid until end_frame
+    int draw_target() const { return frames_drawn % depth; }
+    // Index of the target end_frame just read back
+    int read_target() const { return (frames_drawn - depth) % depth; }
+    // Kick off the frame that was just drawn, then read back the oldest finished frame as RGBA,
+    // along with the size it was drawn at. Returns false while the ring is still filling up and
+    // there's nothing to read yet.
+    bool end_frame(unsigned char* read_to, int* read_width, int* read_height);
+
+    ~FramebufferRing();
+};
+
+#endif
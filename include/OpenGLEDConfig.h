@@ -1,12 +1,38 @@
 #ifndef OPEN_GLED_CONFIG_H
 #define OPEN_GLED_CONFIG_H
 
+#include <map>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include "yaml-cpp/yaml.h"
 
+#include "RealtimeMode.h"
+
+// How the captured channels are turned into the channels that get analysed
+enum class ChannelMix
+{
+    Separate, // every captured channel gets its own bands
+    Mid,      // average of all channels, costs the same as mono
+    MidSide,  // stereo only, (L + R) / 2 and (L - R) / 2
+};
+
+struct LayerConfig
+{
+    std::string shader;                                        // file in the shader folder
+    std::string blend = "normal";                              // normal, add, multiply, screen or lighten
+    float opacity = 1.0;
+    std::vector<std::pair<std::string, std::string>> defines;  // #defined before the layer's code
+};
+
+struct PlaylistConfig
+{
+    std::string name;
+    float seconds = 0; // how long to play before moving to the next playlist, 0 to stay on it
+    std::vector<LayerConfig> layers;
+};
+
 class OpenGLEDConfig
 {
 public:
@@ -16,16 +42,38 @@ public:
     uint8_t brightness = 32;
 
     std::string shader_folder;
+    std::vector<PlaylistConfig> playlists; // empty to just run the first shader in the folder
+    float crossfade_seconds = 2.0;
+
+    // Render settings
+    int pipeline_depth = 2;
+    bool quality_governor = false;
+    float frame_budget_ms = 1000.f / 60.f;
 
     // Audio settings
     std::string alsa_input_device;
     std::vector<float> frequency_bands;
     int channels = 1, sample_rate = 44100, samples_per_pixel = 1024, pixels_per_band = 144;
+    float pregain = 50.0;
+    int max_backlog_blocks = 16; // SAMPLES_PER_PIXEL blocks read and analysed in one go when catching up
+    ChannelMix channel_mix = ChannelMix::Separate;
 
     int num_bands(){ return frequency_bands.size() - 1; }
+    int analysis_channels(){ return channel_mix == ChannelMix::Separate ? channels : (channel_mix == ChannelMix::Mid ? 1 : 2); }
     float center_frequency(int band){ return frequency_bands[band] + (frequency_bands[band+1] - frequency_bands[band]) / 2.f; }
     float band_width(int band){ return frequency_bands[band+1] - frequency_bands[band]; }
 
+    // Runtime control and frame export, empty to disable
+    std::string control_shm_name;
+    std::string control_group; // group that may change parameters besides the renderer's user
+    std::string frame_export_shm_name;
+    int frame_export_slots = 8;
+
+    // Realtime settings
+    bool realtime_enabled = false, lock_memory = true;
+    int prefault_heap_kb = 0, prefault_stack_kb = 0;
+    std::map<std::string, RealtimeThreadSettings> realtime_threads; // e.g. "RENDER" -> priority, cpu
+
     static std::optional<OpenGLEDConfig> FromFile(const char* filename);
 };
 
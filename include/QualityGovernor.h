@@ -0,0 +1,38 @@
+#ifndef QUALITY_GOVERNOR_H
+#define QUALITY_GOVERNOR_H
+
+// Steps quality down when the measured frame or DSP time goes over budget, and back up once
+// there's headroom again. Levels are cumulative, in this order:
+//   0  full quality
+//   1  render at half resolution and upscale to the LED layout
+//   2  also keep half as much audio history in the audio texture
+//   3  also analyse the low bands at half the sample rate
+class QualityGovernor
+{
+private:
+    float budget_seconds;
+    int level = 0;
+    float smoothed_frame_seconds = 0, smoothed_dsp_seconds = 0;
+    int frames_over_budget = 0, frames_with_headroom = 0;
+
+public:
+    static const int MAX_LEVEL = 3;
+
+    QualityGovernor(float budget_seconds) : budget_seconds(budget_seconds) {}
+
+    // Feed in how long the last frame's work took (not counting time spent waiting on the strip)
+    // and how much of that was audio DSP. Returns true when the level changed.
+    bool update(float frame_seconds, float dsp_seconds);
+
+    int quality_level() const { return level; }
+    bool half_resolution() const { return level >= 1; }
+    bool half_audio_history() const { return level >= 2; }
+    bool decimated_analysis() const { return level >= 3; }
+
+    float frame_seconds() const { return smoothed_frame_seconds; }
+    float dsp_seconds() const { return smoothed_dsp_seconds; }
+
+    static const char* describe(int level);
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef REALTIME_MODE_H
+#define REALTIME_MODE_H
+
+#include <cstddef>
+
+struct RealtimeThreadSettings
+{
+    int priority = 0; // SCHED_FIFO priority (1 - 99), 0 leaves the thread time-shared
+    int cpu = -1;     // CPU to pin the thread to, -1 to let the scheduler pick
+};
+
+// Opt-in helpers for running the render loop with realtime guarantees. Everything here needs
+// root (or CAP_SYS_NICE + CAP_IPC_LOCK), and prints why it failed instead of aborting, since
+// the show still works without realtime scheduling, just with more jitter.
+class RealtimeMode
+{
+public:
+    // mlockall() current and future pages, stop malloc from returning memory to the OS, then
+    // touch heap_bytes of heap and stack_bytes of stack so they never page fault later.
+    static bool LockAndPrefaultMemory(bool lock_memory, size_t heap_bytes, size_t stack_bytes);
+
+    // Applies SCHED_FIFO priority and CPU affinity to the calling thread
+    static bool ConfigureCurrentThread(const char* name, const RealtimeThreadSettings& settings);
+};
+
+#endif
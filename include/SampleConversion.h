@@ -0,0 +1,46 @@
+#ifndef SAMPLE_CONVERSION_H
+#define SAMPLE_CONVERSION_H
+
+#include <stdint.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+// Splits interleaved S16 frames into one float buffer per channel, scaled to [-1.0, 1.0).
+// Conversion and deinterleaving happen in the same pass over the input, 8 samples at a time with
+// NEON for the mono and stereo cases, which are the only ones the Pi's I2S mics produce.
+inline void deinterleave_s16_to_float(const int16_t* interleaved, int frames, int channels, float* const* out)
+{
+    const float scale = 1.f / 32768.f; // 32768 is 2^15, the maximum absolute value for int16_t
+    int frame = 0;
+
+#ifdef __ARM_NEON
+    if(channels == 1){
+        for(; frame + 8 <= frames; frame += 8){
+            int16x8_t samples = vld1q_s16(interleaved + frame);
+            vst1q_f32(out[0] + frame, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), scale));
+            vst1q_f32(out[0] + frame + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), scale));
+        }
+    }
+    else if(channels == 2){
+        for(; frame + 8 <= frames; frame += 8){
+            // vld2 does the deinterleave: val[0] gets the left samples, val[1] the right
+            int16x8x2_t samples = vld2q_s16(interleaved + frame * 2);
+            for(int c = 0; c < 2; c++){
+                vst1q_f32(out[c] + frame, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples.val[c]))), scale));
+                vst1q_f32(out[c] + frame + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples.val[c]))), scale));
+            }
+        }
+    }
+#endif
+
+    // Leftover frames, and everything on other platforms (simple enough for the compiler to vectorize)
+    for(; frame < frames; frame++){
+        for(int c = 0; c < channels; c++){
+            out[c][frame] = interleaved[frame * channels + c] * scale;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SHADER_COMPOSITOR_H
+#define SHADER_COMPOSITOR_H
+
+#include <string>
+#include <vector>
+
+#include <GLES2/gl2.h>
+
+#include "OpenGLEDConfig.h"
+
+// Builds every playlist's layer stack into one fragment program so the whole show renders in a
+// single pass. Each layer's main() is renamed into its own function, its globals are prefixed so
+// layers can't collide, and its blend mode, opacity and DEFINES are baked in as constants. The
+// program blends two playlists at a time, which is how crossfades happen without a second pass.
+class ShaderCompositor
+{
+private:
+    std::vector<PlaylistConfig> playlists;
+    std::string shader_folder;
+    float crossfade_seconds;
+
+    int current = 0, next = -1, queued = -1;
+    float playlist_started = 0, crossfade_started = 0;
+
+    GLuint program = 0;
+    GLint playlist_a_location = -1, playlist_b_location = -1, playlist_fade_location = -1;
+
+    std::string layer_function(const LayerConfig& layer, const std::string& prefix);
+
+public:
+    ShaderCompositor(OpenGLEDConfig& config);
+
+    // Throws std::runtime_error if a layer's shader can't be read, declares a uniform the renderer
+    // doesn't set or has an unknown blend mode
+    std::string generate_fragment_shader();
+
+    int num_playlists() const { return playlists.size(); }
+    // Crossfade from whatever is playing to the given playlist, after the current crossfade if one is going
+    void switch_to(int playlist, float now);
+
+    // Advance the playlist timeline and set the crossfade uniforms on the program in use
+    void upload(GLuint program, float now);
+};
+
+#endif
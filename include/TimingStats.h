@@ -0,0 +1,33 @@
+#ifndef TIMING_STATS_H
+#define TIMING_STATS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Keeps the last N duration samples of something (wake-up latency, frame time...) in a fixed
+// ring so it can be recorded from a realtime thread, and reports percentiles over them.
+class TimingStats
+{
+private:
+    std::string name;
+    std::vector<int64_t> samples;
+    std::vector<int64_t> sorted_scratch;
+    int next = 0, count = 0;
+    int64_t max_seen = 0;
+
+public:
+    TimingStats(std::string name, int capacity = 4096);
+
+    void record(int64_t nanoseconds);
+    // Value at the given percentile (0 - 100) of the samples currently held, in nanoseconds
+    int64_t percentile(double p);
+    int size() const { return count; }
+    void clear();
+
+    // e.g. "render: n=4096 p50=812us p99=1034us p99.9=1502us max=2210us"
+    void report(std::ostream& out);
+};
+
+#endif
@@ -1,13 +1,18 @@
 uniform float time;
 uniform vec2 resolution;
 uniform sampler2D audioTexture;
+uniform float audioLevel[8];
+uniform float audioBands;
+uniform float audioChannels;
 
 float sample_between(float coord, float lower, float upper){
     return (upper - lower) * coord + lower;
 }
 
 void main() {
-    float bass_intensity = texture2D(audioTexture, vec2(sample_between(gl_FragCoord.x / resolution.x, 0.75, 1.0), 0.125)).r;
-    float treble_intensity = sin( (-0.4 * time + gl_FragCoord.x / resolution.x) * 60.0 ) * texture2D(audioTexture, vec2(0.99, 0.625)).r;
+    // Middle of band 0's row in channel 0, however many bands and channels the texture has
+    float bass_row = 0.5 / max(audioBands * audioChannels, 1.0);
+    float bass_intensity = texture2D(audioTexture, vec2(sample_between(gl_FragCoord.x / resolution.x, 0.75, 1.0), bass_row)).r;
+    float treble_intensity = sin( (-0.4 * time + gl_FragCoord.x / resolution.x) * 60.0 ) * audioLevel[2];
     gl_FragColor = vec4( bass_intensity, treble_intensity, treble_intensity, 1);
 }
\ No newline at end of file
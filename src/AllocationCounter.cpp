@@ -0,0 +1,97 @@
+#include "AllocationCounter.h"
+
+#ifdef OPENGLED_COUNT_ALLOCATIONS
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Plain integer so counting never allocates itself
+static thread_local unsigned long thread_allocations = 0;
+
+#ifdef OPENGLED_WRAP_MALLOC
+// Linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, so malloc calls from the program's
+// own code are counted too. Calls from inside libc or other shared libraries aren't.
+extern "C" void* __real_malloc(std::size_t size);
+extern "C" void* __real_calloc(std::size_t count, std::size_t size);
+extern "C" void* __real_realloc(void* memory, std::size_t size);
+
+extern "C" void* __wrap_malloc(std::size_t size)
+{
+    thread_allocations++;
+    return __real_malloc(size);
+}
+
+extern "C" void* __wrap_calloc(std::size_t count, std::size_t size)
+{
+    thread_allocations++;
+    return __real_calloc(count, size);
+}
+
+extern "C" void* __wrap_realloc(void* memory, std::size_t size)
+{
+    thread_allocations++;
+    return __real_realloc(memory, size);
+}
+
+static void* uncounted_malloc(std::size_t size) { return __real_malloc(size); }
+#else
+static void* uncounted_malloc(std::size_t size) { return std::malloc(size); }
+#endif
+
+static void* counted_allocation(std::size_t size)
+{
+    thread_allocations++;
+    return uncounted_malloc(size ? size : 1);
+}
+
+static void* counted_allocation(std::size_t size, std::align_val_t alignment)
+{
+    thread_allocations++;
+    void* memory = nullptr;
+    std::size_t align = std::max((std::size_t) alignment, sizeof(void*));
+    if(posix_memalign(&memory, align, size ? size : 1) != 0) return nullptr;
+    return memory;
+}
+
+void* operator new(std::size_t size)
+{
+    if(void* memory = counted_allocation(size)) return memory;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_allocation(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_allocation(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if(void* memory = counted_allocation(size, alignment)) return memory;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return counted_allocation(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return counted_allocation(size, alignment); }
+
+// posix_memalign memory is released with free() as well, so every delete is the same
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { std::free(memory); }
+
+bool AllocationCounter::enabled() { return true; }
+unsigned long AllocationCounter::allocations_on_this_thread() { return thread_allocations; }
+
+#else
+
+bool AllocationCounter::enabled() { return false; }
+unsigned long AllocationCounter::allocations_on_this_thread() { return 0; }
+
+#endif
@@ -0,0 +1,174 @@
+#include "AudioAnalyzer.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "SampleConversion.h"
+
+AudioAnalyzer::AudioAnalyzer(OpenGLEDConfig& config)
+    : input_channels(config.channels), analysis_channels(config.analysis_channels()), num_bands(config.num_bands()),
+      samples_per_pixel(config.samples_per_pixel), pixels_per_band(config.pixels_per_band), history_length(config.pixels_per_band),
+      max_blocks(config.max_backlog_blocks),
+      channel_mix(config.channel_mix), pregain(config.pregain)
+{
+    int batch_samples = max_blocks * samples_per_pixel;
+
+    input_samples.resize(input_channels, std::vector<float>(batch_samples));
+    for(std::vector<float>& channel : input_samples){
+        input_pointers.push_back(channel.data());
+    }
+    // Separate channels are analysed straight from the deinterleaved input
+    if(channel_mix != ChannelMix::Separate){
+        analysis_samples.resize(analysis_channels, std::vector<float>(batch_samples));
+    }
+
+    band_filters.resize(channel_pairs() * num_bands);
+    decimated_filters.resize(channel_pairs() * num_bands);
+    band_decimatable.resize(num_bands);
+    decimated_samples.resize(2 * max_blocks * (samples_per_pixel / 2));
+    for(int row = 0; row < rows(); row++){
+        band_pixel_buffers.emplace_back(pixels_per_band);
+    }
+    setup_filters(config);
+
+    texture_data.resize(pixels_per_band * rows(), 0);
+    levels.resize(rows(), 0.f);
+    block_means.resize(max_blocks * num_bands, 0.f);
+}
+
+void AudioAnalyzer::setup_filters(OpenGLEDConfig& config)
+{
+    for(int band = 0; band < num_bands; band++){
+        design.setup(config.sample_rate, config.center_frequency(band), config.band_width(band));
+        for(int pair = 0; pair < channel_pairs(); pair++){
+            band_filters[pair * num_bands + band].setup(design);
+        }
+
+        band_decimatable[band] = config.frequency_bands[band+1] < config.sample_rate / 4.f;
+        if(!band_decimatable[band]) continue;
+        design.setup(config.sample_rate / 2.f, config.center_frequency(band), config.band_width(band));
+        for(int pair = 0; pair < channel_pairs(); pair++){
+            decimated_filters[pair * num_bands + band].setup(design);
+        }
+    }
+}
+
+void AudioAnalyzer::set_decimation(bool decimate)
+{
+    if(decimate == this->decimate) return;
+    this->decimate = decimate;
+
+    // The filters being switched to have stale state from whenever they last ran
+    std::vector<BandFilter>& switching_to = decimate ? decimated_filters : band_filters;
+    for(size_t i = 0; i < switching_to.size(); i++){
+        if(band_decimatable[i % num_bands]) switching_to[i].reset();
+    }
+}
+
+void AudioAnalyzer::set_history_length(int history_length)
+{
+    this->history_length = std::max(1, std::min(history_length, pixels_per_band));
+    update_texture();
+}
+
+void AudioAnalyzer::update_texture()
+{
+    for(int row = 0; row < rows(); row++){
+        band_pixel_buffers[row].peek_latest(texture_data.data() + row * history_length, history_length);
+    }
+}
+
+void AudioAnalyzer::process_batch(const char* interleaved, int blocks, float* const* band_debug_out)
+{
+    blocks = std::min(blocks, max_blocks);
+    int batch_samples = blocks * samples_per_pixel;
+
+    // S16_LE -> float, one buffer per channel, in one pass over the whole batch
+    deinterleave_s16_to_float((const int16_t*) interleaved, batch_samples, input_channels, input_pointers.data());
+
+    std::vector<std::vector<float>>& channels = channel_mix == ChannelMix::Separate ? input_samples : analysis_samples;
+    if(channel_mix == ChannelMix::Mid){
+        float scale = 1.f / input_channels;
+        for(int s = 0; s < batch_samples; s++){
+            float sum = 0;
+            for(int c = 0; c < input_channels; c++) sum += input_samples[c][s];
+            analysis_samples[0][s] = sum * scale;
+        }
+    }
+    else if(channel_mix == ChannelMix::MidSide){
+        for(int s = 0; s < batch_samples; s++){
+            analysis_samples[0][s] = (input_samples[0][s] + input_samples[1][s]) * 0.5f;
+            analysis_samples[1][s] = (input_samples[0][s] - input_samples[1][s]) * 0.5f;
+        }
+    }
+
+    std::fill(block_means.begin(), block_means.begin() + blocks * num_bands, 0.f);
+
+    // Filter each pair of channels into bands in lockstep, running each filter over every block
+    // of the batch while its state is hot
+
+    int half_block = samples_per_pixel / 2;
+    int decimated_lane_size = max_blocks * half_block;
+    bool use_decimated = decimate && half_block > 0;
+
+    for(int pair = 0; pair < channel_pairs(); pair++){
+        int first_channel = pair * 2;
+        int lanes = std::min(2, analysis_channels - first_channel);
+
+        if(use_decimated){
+            for(int lane = 0; lane < lanes; lane++){
+                const float* samples = channels[first_channel + lane].data();
+                float* averaged = decimated_samples.data() + lane * decimated_lane_size;
+                for(int s = 0; s < blocks * half_block; s++){
+                    // Pairs never straddle blocks, each block has its own half_block averages
+                    int block = s / half_block, offset = s % half_block;
+                    averaged[s] = (samples[block * samples_per_pixel + 2*offset] + samples[block * samples_per_pixel + 2*offset + 1]) * 0.5f;
+                }
+            }
+        }
+
+        for(int band = 0; band < num_bands; band++){
+            bool half_rate = use_decimated && band_decimatable[band];
+            BandFilter& filter = (half_rate ? decimated_filters : band_filters)[pair * num_bands + band];
+            int count = half_rate ? half_block : samples_per_pixel;
+
+            for(int block = 0; block < blocks; block++){
+                const float* in[2] = {nullptr, nullptr};
+                float* debug_out[2] = {nullptr, nullptr};
+                for(int lane = 0; lane < lanes; lane++){
+                    in[lane] = half_rate ? decimated_samples.data() + lane * decimated_lane_size + block * half_block
+                                         : channels[first_channel + lane].data() + block * samples_per_pixel;
+                    if(band_debug_out) debug_out[lane] = band_debug_out[(first_channel + lane) * num_bands + band] + block * samples_per_pixel;
+                }
+
+                // Filter and sum the squares in the same pass, the filtered samples are only kept for debugging
+                double sums[2] = {0, 0};
+                if(lanes == 2) filter.filter_pair(in[0], in[1], count, &sums[0], &sums[1], debug_out[0], debug_out[1]);
+                else sums[0] = filter.filter(in[0], count, debug_out[0]);
+
+                for(int lane = 0; lane < lanes; lane++){
+                    int row = (first_channel + lane) * num_bands + band;
+
+                    if(half_rate){
+                        sums[lane] *= 2.0; // each filtered sample stands in for two
+                        if(debug_out[lane]){
+                            // Spread the half rate output back over the block, from the end so nothing is overwritten early
+                            if(samples_per_pixel % 2) debug_out[lane][samples_per_pixel-1] = 0;
+                            for(int s = half_block - 1; s >= 0; s--){
+                                debug_out[lane][2*s] = debug_out[lane][2*s+1] = debug_out[lane][s];
+                            }
+                        }
+                    }
+
+                    // Calculate brightness of next pixel from db RMS
+                    // This rms measurement seems to just be garbage data? not correlated with the volume at all
+                    double rms = sqrt(sums[lane] / samples_per_pixel) * pregain;
+
+                    band_pixel_buffers[row].push_back((unsigned char) (rms * 255.5)); // .5 so it rounds correctly
+                    levels[row] = rms;
+                    block_means[block * num_bands + band] += rms / analysis_channels;
+                }
+            }
+        }
+    }
+}
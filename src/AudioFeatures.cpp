@@ -0,0 +1,150 @@
+#include "AudioFeatures.h"
+
+#include <algorithm>
+#include <math.h>
+
+// How long a peak is held before it starts falling, and how fast it falls after that
+#define PEAK_HOLD_SECONDS 0.5f
+#define PEAK_FALL_PER_SECOND 1.0f
+// Time constant of the running average an onset has to jump above
+#define AVERAGE_SECONDS 1.0f
+#define ONSET_RATIO 1.5f
+#define ONSET_MIN_LEVEL 0.05f
+// Ignore onsets closer together than this, 0.25s caps the tempo at 240 BPM
+#define ONSET_REFRACTORY_SECONDS 0.25f
+#define MIN_BEAT_INTERVAL_SECONDS 0.3f
+#define MAX_BEAT_INTERVAL_SECONDS 2.0f
+#define BEAT_INTERVALS_TO_AVERAGE 8
+
+AudioFeatureExtractor::AudioFeatureExtractor(OpenGLEDConfig& config) : beat_intervals(BEAT_INTERVALS_TO_AVERAGE)
+{
+    num_bands = std::min(config.num_bands(), MAX_AUDIO_FEATURE_BANDS);
+    texture_bands = config.num_bands();
+    texture_channels = config.analysis_channels();
+    blocks_per_second = (float) config.sample_rate / config.samples_per_pixel;
+
+    for(int band = 0; band < num_bands; band++){
+        log_center_frequencies.push_back(log2f(config.center_frequency(band)));
+    }
+    log_lowest_frequency = log2f(std::max(config.frequency_bands.front(), 1.f));
+    log_highest_frequency = log2f(config.frequency_bands.back());
+}
+
+void AudioFeatureExtractor::update_bpm(float interval)
+{
+    beat_intervals.push_back(interval);
+
+    // Median of the recent intervals, so one missed or doubled beat doesn't move the tempo
+    float intervals[BEAT_INTERVALS_TO_AVERAGE];
+    int count = beat_intervals.peek(intervals, BEAT_INTERVALS_TO_AVERAGE);
+    if(count < 3) return;
+
+    std::nth_element(intervals, intervals + count / 2, intervals + count);
+    bpm = 60.f / intervals[count / 2];
+}
+
+void AudioFeatureExtractor::process_block(const float* band_levels)
+{
+    const float average_rate = 1.f / (AVERAGE_SECONDS * blocks_per_second);
+    const int peak_hold_blocks = PEAK_HOLD_SECONDS * blocks_per_second;
+    const int refractory_blocks = ONSET_REFRACTORY_SECONDS * blocks_per_second;
+
+    float weighted_frequency_sum = 0, level_sum = 0;
+
+    for(int band = 0; band < num_bands; band++){
+        float level = std::clamp(band_levels[band], 0.f, 1.f);
+        levels[band] = level;
+
+        // Peak hold
+        if(level >= peaks[band]){
+            peaks[band] = level;
+            peak_ages[band] = 0;
+        }
+        else if(++peak_ages[band] > peak_hold_blocks){
+            peaks[band] = std::max(level, peaks[band] - PEAK_FALL_PER_SECOND / blocks_per_second);
+        }
+
+        // Start the average at the first real level instead of 0, or the first sound is always an onset
+        if(!averages_seeded[band] && level > ONSET_MIN_LEVEL){
+            averages[band] = level;
+            averages_seeded[band] = true;
+        }
+
+        // Onset when the level jumps well above its recent average
+        blocks_since_onset[band]++;
+        if(level > ONSET_MIN_LEVEL && level > averages[band] * ONSET_RATIO && blocks_since_onset[band] > refractory_blocks){
+            onsets[band] = 1.f;
+            blocks_since_onset[band] = 0;
+
+            // Beats come from the lowest band
+            if(band == 0){
+                beat = 1.f;
+                if(last_beat_block >= 0){
+                    float interval = (blocks_processed - last_beat_block) / blocks_per_second;
+                    if(interval >= MIN_BEAT_INTERVAL_SECONDS && interval <= MAX_BEAT_INTERVAL_SECONDS){
+                        update_bpm(interval);
+                    }
+                }
+                last_beat_block = blocks_processed;
+            }
+        }
+        averages[band] += (level - averages[band]) * average_rate;
+
+        weighted_frequency_sum += level * log_center_frequencies[band];
+        level_sum += level;
+    }
+
+    // Spectral centroid over the bands, normalized to the configured frequency range
+    if(level_sum > 0){
+        centroid = (weighted_frequency_sum / level_sum - log_lowest_frequency) / (log_highest_frequency - log_lowest_frequency);
+    }
+
+    blocks_processed++;
+}
+
+const AudioFeatureExtractor::UniformLocations& AudioFeatureExtractor::locations_for(GLuint program)
+{
+    for(const UniformLocations& locations : programs){
+        if(locations.program == program) return locations;
+    }
+
+    // First time seeing this program, look the uniforms up once
+    UniformLocations locations;
+    locations.program = program;
+    locations.level = glGetUniformLocation(program, "audioLevel");
+    locations.peak = glGetUniformLocation(program, "audioPeak");
+    locations.onset = glGetUniformLocation(program, "audioOnset");
+    locations.beat = glGetUniformLocation(program, "audioBeat");
+    locations.beat_phase = glGetUniformLocation(program, "audioBeatPhase");
+    locations.bpm = glGetUniformLocation(program, "audioBpm");
+    locations.centroid = glGetUniformLocation(program, "audioCentroid");
+    locations.bands = glGetUniformLocation(program, "audioBands");
+    locations.channels = glGetUniformLocation(program, "audioChannels");
+    programs.push_back(locations);
+    return programs.back();
+}
+
+void AudioFeatureExtractor::upload(GLuint program)
+{
+    const UniformLocations& locations = locations_for(program);
+
+    float beat_phase = 0;
+    if(bpm > 0 && last_beat_block >= 0){
+        float seconds_since_beat = (blocks_processed - last_beat_block) / blocks_per_second;
+        beat_phase = std::min(1.f, seconds_since_beat * bpm / 60.f);
+    }
+
+    // Locations are -1 for uniforms the shader doesn't use, which GL ignores
+    glUniform1fv(locations.level, num_bands, levels);
+    glUniform1fv(locations.peak, num_bands, peaks);
+    glUniform1fv(locations.onset, num_bands, onsets);
+    glUniform1f(locations.beat, beat);
+    glUniform1f(locations.beat_phase, beat_phase);
+    glUniform1f(locations.bpm, bpm);
+    glUniform1f(locations.centroid, centroid);
+    glUniform1f(locations.bands, (float) texture_bands);
+    glUniform1f(locations.channels, (float) texture_channels);
+
+    std::fill(onsets, onsets + num_bands, 0.f);
+    beat = 0;
+}
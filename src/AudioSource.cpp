@@ -0,0 +1,136 @@
+#include "AudioSource.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CLICK_FREQUENCY 100.0
+#define CLICK_SECONDS 0.03
+#define CLICK_AMPLITUDE 0.8
+
+static timespec add_nanoseconds(timespec time, int64_t nanoseconds)
+{
+    int64_t total = time.tv_nsec + nanoseconds;
+    time.tv_sec += total / 1000000000L;
+    time.tv_nsec = total % 1000000000L;
+    if(time.tv_nsec < 0){
+        time.tv_sec--;
+        time.tv_nsec += 1000000000L;
+    }
+    return time;
+}
+
+bool TimestampedCaptureDevice::enable_timestamps()
+{
+    snd_pcm_sw_params_t* sw_params;
+    snd_pcm_sw_params_malloc(&sw_params);
+
+    int err = snd_pcm_sw_params_current(handle, sw_params);
+    if(err >= 0) err = snd_pcm_sw_params_set_tstamp_mode(handle, sw_params, SND_PCM_TSTAMP_ENABLE);
+    if(err >= 0) err = snd_pcm_sw_params_set_tstamp_type(handle, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+    if(err >= 0) err = snd_pcm_sw_params(handle, sw_params);
+
+    snd_pcm_sw_params_free(sw_params);
+
+    if(err < 0){
+        fprintf(stderr, "Failed to enable ALSA timestamps: %s\n", snd_strerror(err));
+        return false;
+    }
+    return true;
+}
+
+bool TimestampedCaptureDevice::timestamp_of_sample(long* frames_still_buffered, timespec* captured)
+{
+    snd_pcm_status_t* status;
+    snd_pcm_status_alloca(&status);
+    if(snd_pcm_status(handle, status) < 0) return false;
+
+    // With timestamps enabled htstamp is when hw_ptr last moved, i.e. when the newest buffered frame was captured
+    snd_pcm_status_get_htstamp(status, captured);
+    *frames_still_buffered = snd_pcm_status_get_avail(status);
+    return true;
+}
+
+ALSAAudioSource::ALSAAudioSource(std::string device_name, int sample_rate, int channels, int frames_per_period)
+    : device(device_name, sample_rate, channels, frames_per_period, SND_PCM_FORMAT_S16_LE), sample_rate(sample_rate)
+{
+}
+
+bool ALSAAudioSource::open()
+{
+    if(!device.open()) return false;
+    // Without timestamps the latency numbers fall back to when the samples were read
+    device.enable_timestamps();
+    return true;
+}
+
+void ALSAAudioSource::close()
+{
+    device.close();
+}
+
+void ALSAAudioSource::capture_into_buffer(char* buffer, int frames)
+{
+    device.capture_into_buffer(buffer, frames);
+
+    long frames_still_buffered;
+    timespec newest;
+    if(device.timestamp_of_sample(&frames_still_buffered, &newest) && (newest.tv_sec != 0 || newest.tv_nsec != 0)){
+        // The last frame we read was captured frames_still_buffered frames before the newest one
+        last_capture = add_nanoseconds(newest, -frames_still_buffered * 1000000000L / sample_rate);
+    }
+    else{
+        clock_gettime(CLOCK_MONOTONIC, &last_capture);
+    }
+}
+
+ClickAudioSource::ClickAudioSource(int sample_rate, int channels, float click_interval)
+    : sample_rate(sample_rate), channels(channels)
+{
+    click_interval_samples = click_interval * sample_rate;
+    click_length_samples = CLICK_SECONDS * sample_rate;
+}
+
+timespec ClickAudioSource::time_of_sample(long sample)
+{
+    return add_nanoseconds(started, (int64_t) sample * 1000000000L / sample_rate);
+}
+
+bool ClickAudioSource::open()
+{
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    samples_produced = 0;
+    return true;
+}
+
+long ClickAudioSource::samples_left_to_read()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t elapsed_us = (now.tv_sec - started.tv_sec) * 1000000L + (now.tv_nsec - started.tv_nsec) / 1000;
+    return elapsed_us * sample_rate / 1000000L - samples_produced;
+}
+
+void ClickAudioSource::capture_into_buffer(char* buffer, int frames)
+{
+    int16_t* samples = (int16_t*) buffer;
+
+    for(int f = 0; f < frames; f++){
+        long position = (samples_produced + f) % click_interval_samples;
+        float value = 0;
+        if(position < click_length_samples){
+            value = CLICK_AMPLITUDE * sin(2.0 * M_PI * CLICK_FREQUENCY * position / sample_rate);
+        }
+        for(int c = 0; c < channels; c++){
+            samples[f * channels + c] = (int16_t) (value * 32767);
+        }
+    }
+
+    samples_produced += frames;
+}
+
+timespec ClickAudioSource::last_click_timestamp()
+{
+    long last_click = (samples_produced - 1) / click_interval_samples * click_interval_samples;
+    return time_of_sample(last_click);
+}
@@ -0,0 +1,140 @@
+#include "ControlPlane.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <new>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Control plane needs lock-free 64 bit atomics to work across processes");
+
+bool ControlPlane::Initialize(const ControlParameters* initial)
+{
+    int fd = shm_open(name.c_str(), create ? (O_CREAT | O_RDWR) : O_RDWR, 0660);
+    if(fd < 0){
+        fprintf(stderr, "Failed to open control segment %s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    // The mode passed to shm_open only applies to a new segment and goes through the umask, so set
+    // it again; an existing segment from an older open_gled may still be world writable
+    if(create){
+        if(!owner_group.empty()){
+            struct group* entry = getgrnam(owner_group.c_str());
+            if(!entry){
+                fprintf(stderr, "Control segment group %s doesn't exist\n", owner_group.c_str());
+                close(fd);
+                return false;
+            }
+            if(fchown(fd, (uid_t) -1, entry->gr_gid) != 0){
+                fprintf(stderr, "Failed to give control segment %s to group %s: %s\n", name.c_str(), owner_group.c_str(), strerror(errno));
+                close(fd);
+                return false;
+            }
+        }
+        if(fchmod(fd, 0660) != 0){
+            fprintf(stderr, "Failed to set the mode of control segment %s: %s\n", name.c_str(), strerror(errno));
+            close(fd);
+            return false;
+        }
+    }
+
+    if(create && ftruncate(fd, sizeof(ControlBlock)) != 0){
+        fprintf(stderr, "Failed to size control segment %s: %s\n", name.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    void* memory = mmap(nullptr, sizeof(ControlBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED){
+        fprintf(stderr, "Failed to map control segment %s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    if(create){
+        block = new (memory) ControlBlock();
+        block->slots[0] = *initial;
+        block->slots[1] = *initial;
+        block->layout_version = CONTROL_PLANE_LAYOUT_VERSION;
+        block->version.store(0, std::memory_order_release);
+        // Written last so clients that open the segment early see it isn't ready yet
+        std::atomic_thread_fence(std::memory_order_release);
+        block->magic = CONTROL_PLANE_MAGIC;
+    }
+    else{
+        block = (ControlBlock*) memory;
+        if(block->magic != CONTROL_PLANE_MAGIC || block->layout_version != CONTROL_PLANE_LAYOUT_VERSION){
+            fprintf(stderr, "Control segment %s isn't from a compatible open_gled\n", name.c_str());
+            munmap(memory, sizeof(ControlBlock));
+            block = nullptr;
+            return false;
+        }
+    }
+
+    seen_version = block->version.load(std::memory_order_acquire);
+    return true;
+}
+
+bool ControlPlane::poll(ControlParameters& params)
+{
+    uint64_t version = block->version.load(std::memory_order_acquire);
+    if(version == seen_version) return false;
+
+    params = block->slots[version % 2];
+
+    // A writer only starts overwriting this slot once version + 1 is visible, so if the version
+    // moved at all the copy may be torn; leave seen_version alone and try again next frame
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(block->version.load(std::memory_order_relaxed) != version) return false;
+
+    seen_version = version;
+    return true;
+}
+
+ControlParameters ControlPlane::read()
+{
+    while(block->writer_lock.exchange(1, std::memory_order_acquire)) sched_yield();
+    ControlParameters params = block->slots[block->version.load(std::memory_order_relaxed) % 2];
+    block->writer_lock.store(0, std::memory_order_release);
+    return params;
+}
+
+void ControlPlane::publish(const ControlParameters& params)
+{
+    while(block->writer_lock.exchange(1, std::memory_order_acquire)) sched_yield();
+
+    uint64_t version = block->version.load(std::memory_order_relaxed);
+    block->slots[(version + 1) % 2] = params;
+    block->version.store(version + 1, std::memory_order_release);
+
+    block->writer_lock.store(0, std::memory_order_release);
+}
+
+bool ControlPlane::ValidBandCutoffs(const float* cutoffs, int count, int sample_rate, std::string* error)
+{
+    std::string problem;
+    for(int i = 0; i < count && problem.empty(); i++){
+        if(!std::isfinite(cutoffs[i]) || cutoffs[i] <= 0) problem = "cutoffs need to be positive numbers";
+        else if(cutoffs[i] >= sample_rate / 2.f) problem = "cutoffs need to be below " + std::to_string(sample_rate / 2) + "Hz (half the sample rate)";
+        else if(i > 0 && cutoffs[i] <= cutoffs[i-1]) problem = "cutoffs need to be in ascending order";
+    }
+
+    if(error) *error = problem;
+    return problem.empty();
+}
+
+ControlPlane::~ControlPlane()
+{
+    if(block){
+        munmap(block, sizeof(ControlBlock));
+    }
+    if(create){
+        shm_unlink(name.c_str());
+    }
+}
@@ -0,0 +1,156 @@
+#include "FrameExport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Frame export needs lock-free 64 bit atomics to work across processes");
+
+// Slots and the header are kept on separate cache lines so readers don't slow down writes
+static size_t cache_line_align(size_t bytes)
+{
+    return (bytes + 63) / 64 * 64;
+}
+
+FrameExport::FrameExport(std::string name, int width, int height, int num_bands, int slot_count)
+    : name(name), create(true), width(width), height(height), num_bands(num_bands), slot_count(slot_count)
+{
+    slot_stride = cache_line_align(sizeof(FrameExportSlot) + num_bands * sizeof(float) + width * height * sizeof(uint32_t));
+    memory_size = cache_line_align(sizeof(FrameExportHeader)) + slot_stride * slot_count;
+}
+
+FrameExport::FrameExport(std::string name) : name(name), create(false)
+{
+}
+
+bool FrameExport::Initialize()
+{
+    // A segment left by an earlier run may still be mapped by readers. Resizing it in place would
+    // fault them with SIGBUS, so it's unlinked and a new one created; they keep the old one mapped.
+    if(create) shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDONLY, 0644);
+    if(fd < 0){
+        fprintf(stderr, "Failed to open frame export segment %s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    if(create){
+        if(ftruncate(fd, memory_size) != 0){
+            fprintf(stderr, "Failed to size frame export segment %s: %s\n", name.c_str(), strerror(errno));
+            close(fd);
+            return false;
+        }
+    }
+    else{
+        struct stat info;
+        fstat(fd, &info);
+        memory_size = info.st_size;
+        if(memory_size < sizeof(FrameExportHeader)){
+            fprintf(stderr, "Frame export segment %s isn't ready yet\n", name.c_str());
+            close(fd);
+            return false;
+        }
+    }
+
+    void* mapped = mmap(nullptr, memory_size, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED){
+        fprintf(stderr, "Failed to map frame export segment %s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+    memory = (uint8_t*) mapped;
+
+    if(create){
+        header_ = new (memory) FrameExportHeader();
+        header_->layout_version = FRAME_EXPORT_LAYOUT_VERSION;
+        header_->width = width;
+        header_->height = height;
+        header_->num_bands = num_bands;
+        header_->slot_count = slot_count;
+        header_->slot_stride = slot_stride;
+        header_->frames_written.store(0, std::memory_order_relaxed);
+
+        for(uint32_t i = 0; i < header_->slot_count; i++){
+            new ((void*) slot(i)) FrameExportSlot();
+        }
+
+        // Written last so readers that open the segment early see it isn't ready yet
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = FRAME_EXPORT_MAGIC;
+    }
+    else{
+        header_ = (FrameExportHeader*) memory;
+        bool compatible = header_->magic == FRAME_EXPORT_MAGIC && header_->layout_version == FRAME_EXPORT_LAYOUT_VERSION;
+
+        // Don't trust the header to stay inside the mapping, every slot has to fit in the segment
+        // and hold the bands and LEDs it claims to
+        uint64_t slot_size = sizeof(FrameExportSlot) + (uint64_t) header_->num_bands * sizeof(float)
+                           + (uint64_t) header_->width * header_->height * sizeof(uint32_t);
+        bool consistent = header_->slot_count > 0 && header_->slot_stride >= slot_size
+                       && header_->slot_stride % alignof(FrameExportSlot) == 0
+                       && memory_size >= cache_line_align(sizeof(FrameExportHeader)) + (uint64_t) header_->slot_count * header_->slot_stride;
+
+        if(!compatible || !consistent){
+            if(!compatible) fprintf(stderr, "Frame export segment %s isn't from a compatible open_gled\n", name.c_str());
+            else fprintf(stderr, "Frame export segment %s has a layout that doesn't fit its size\n", name.c_str());
+            munmap(memory, memory_size);
+            memory = nullptr;
+            header_ = nullptr;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const FrameExportSlot* FrameExport::slot(uint64_t frame_number) const
+{
+    return (const FrameExportSlot*) (memory + cache_line_align(sizeof(FrameExportHeader)) + (frame_number % header_->slot_count) * header_->slot_stride);
+}
+
+void FrameExport::publish(const uint32_t* led_data, const float* band_levels, uint8_t brightness, int quality_level, timespec sent)
+{
+    uint64_t frame_number = header_->frames_written.load(std::memory_order_relaxed);
+    FrameExportSlot* writing = (FrameExportSlot*) slot(frame_number);
+
+    // Odd sequence while writing, so readers know to skip or retry this slot
+    uint64_t sequence = writing->sequence.load(std::memory_order_relaxed);
+    writing->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    writing->frame_number = frame_number;
+    writing->timestamp_ns = (uint64_t) sent.tv_sec * 1000000000ULL + sent.tv_nsec;
+    writing->brightness = brightness;
+    writing->quality_level = quality_level;
+    memcpy((float*) bands(writing), band_levels, header_->num_bands * sizeof(float));
+    memcpy((uint32_t*) leds(writing), led_data, header_->width * header_->height * sizeof(uint32_t));
+
+    writing->sequence.store(sequence + 2, std::memory_order_release);
+    header_->frames_written.store(frame_number + 1, std::memory_order_release);
+}
+
+uint64_t FrameExport::begin_read(const FrameExportSlot* slot)
+{
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    return sequence % 2 == 0 ? sequence : 0;
+}
+
+bool FrameExport::end_read(const FrameExportSlot* slot, uint64_t sequence)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return sequence != 0 && slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+FrameExport::~FrameExport()
+{
+    if(memory){
+        munmap(memory, memory_size);
+        if(create) shm_unlink(name.c_str());
+    }
+}
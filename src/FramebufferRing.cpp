@@ -0,0 +1,72 @@
+#include "FramebufferRing.h"
+
+#include <stdio.h>
+
+bool FramebufferRing::Initialize()
+{
+    framebuffers.resize(depth);
+    textures.resize(depth);
+    drawn_widths.resize(depth, width);
+    drawn_heights.resize(depth, height);
+    glGenFramebuffers(depth, framebuffers.data());
+    glGenTextures(depth, textures.data());
+
+    for(int i = 0; i < depth; i++){
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+            fprintf(stderr, "Offscreen framebuffer %d is incomplete\n", i);
+            return false;
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Frames are read back as tightly packed rows. RGBA rows are always a multiple of 4 bytes, but
+    // don't depend on that if the format ever changes
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    return true;
+}
+
+void FramebufferRing::set_render_size(int render_width, int render_height)
+{
+    this->render_width = render_width;
+    this->render_height = render_height;
+}
+
+void FramebufferRing::begin_frame()
+{
+    int target = frames_drawn % depth;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[target]);
+    glViewport(0, 0, render_width, render_height);
+    drawn_widths[target] = render_width;
+    drawn_heights[target] = render_height;
+}
+
+bool FramebufferRing::end_frame(unsigned char* read_to, int* read_width, int* read_height)
+{
+    // Submit the draw without waiting on it, the GPU works on it while we read an older frame
+    glFlush();
+    frames_drawn++;
+
+    if(frames_drawn < depth) return false;
+
+    int target = (frames_drawn - depth) % depth;
+    *read_width = drawn_widths[target];
+    *read_height = drawn_heights[target];
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[target]);
+    glReadPixels(0, 0, *read_width, *read_height, GL_RGBA, GL_UNSIGNED_BYTE, read_to); // the only format GLES2 guarantees
+    return true;
+}
+
+FramebufferRing::~FramebufferRing()
+{
+    glDeleteFramebuffers(framebuffers.size(), framebuffers.data());
+    glDeleteTextures(textures.size(), textures.data());
+}
@@ -38,6 +38,18 @@ std::optional<OpenGLEDConfig> OpenGLEDConfig::FromFile(const char* filename)
         if(config["AUDIO_SETTINGS"]["CHANNELS"])
             return_config.channels = config["AUDIO_SETTINGS"]["CHANNELS"].as<int>();
 
+        if(config["AUDIO_SETTINGS"]["CHANNEL_MIX"]){
+            std::string mix = config["AUDIO_SETTINGS"]["CHANNEL_MIX"].as<std::string>();
+            if(mix == "separate") return_config.channel_mix = ChannelMix::Separate;
+            else if(mix == "mid") return_config.channel_mix = ChannelMix::Mid;
+            else if(mix == "mid_side") return_config.channel_mix = ChannelMix::MidSide;
+            else throw std::runtime_error("CHANNEL_MIX needs to be separate, mid or mid_side.");
+
+            if(return_config.channel_mix == ChannelMix::MidSide && return_config.channels != 2){
+                throw std::runtime_error("CHANNEL_MIX mid_side needs 2 CHANNELS.");
+            }
+        }
+
         if(config["AUDIO_SETTINGS"]["SAMPLE_RATE"])
             return_config.sample_rate = config["AUDIO_SETTINGS"]["SAMPLE_RATE"].as<int>();
 
@@ -46,9 +58,103 @@ std::optional<OpenGLEDConfig> OpenGLEDConfig::FromFile(const char* filename)
 
         if(config["AUDIO_SETTINGS"]["PIXELS_PER_BAND"])
             return_config.pixels_per_band = config["AUDIO_SETTINGS"]["PIXELS_PER_BAND"].as<int>();
+
+        if(config["AUDIO_SETTINGS"]["PREGAIN"])
+            return_config.pregain = config["AUDIO_SETTINGS"]["PREGAIN"].as<float>();
+
+        if(config["AUDIO_SETTINGS"]["MAX_BACKLOG_BLOCKS"])
+            return_config.max_backlog_blocks = config["AUDIO_SETTINGS"]["MAX_BACKLOG_BLOCKS"].as<int>();
+
+        if(return_config.max_backlog_blocks < 1){
+            throw std::runtime_error("MAX_BACKLOG_BLOCKS needs to be at least 1.");
+        }
+    }
+
+    if(config["RENDER_SETTINGS"]){
+        if(config["RENDER_SETTINGS"]["PIPELINE_DEPTH"])
+            return_config.pipeline_depth = config["RENDER_SETTINGS"]["PIPELINE_DEPTH"].as<int>();
+        if(config["RENDER_SETTINGS"]["QUALITY_GOVERNOR"])
+            return_config.quality_governor = config["RENDER_SETTINGS"]["QUALITY_GOVERNOR"].as<bool>();
+        if(config["RENDER_SETTINGS"]["FRAME_BUDGET_MS"])
+            return_config.frame_budget_ms = config["RENDER_SETTINGS"]["FRAME_BUDGET_MS"].as<float>();
+
+        if(return_config.pipeline_depth < 1){
+            throw std::runtime_error("PIPELINE_DEPTH needs to be at least 1.");
+        }
+        if(return_config.frame_budget_ms <= 0){
+            throw std::runtime_error("FRAME_BUDGET_MS needs to be positive.");
+        }
+    }
+
+    if(config["CONTROL_SETTINGS"]){
+        if(config["CONTROL_SETTINGS"]["SHM_NAME"])
+            return_config.control_shm_name = config["CONTROL_SETTINGS"]["SHM_NAME"].as<std::string>();
+        if(config["CONTROL_SETTINGS"]["GROUP"])
+            return_config.control_group = config["CONTROL_SETTINGS"]["GROUP"].as<std::string>();
+    }
+
+    if(config["FRAME_EXPORT_SETTINGS"]){
+        if(config["FRAME_EXPORT_SETTINGS"]["SHM_NAME"])
+            return_config.frame_export_shm_name = config["FRAME_EXPORT_SETTINGS"]["SHM_NAME"].as<std::string>();
+        if(config["FRAME_EXPORT_SETTINGS"]["SLOTS"])
+            return_config.frame_export_slots = config["FRAME_EXPORT_SETTINGS"]["SLOTS"].as<int>();
+
+        if(return_config.frame_export_slots < 2){
+            throw std::runtime_error("FRAME_EXPORT_SETTINGS SLOTS needs to be at least 2.");
+        }
+    }
+
+    if(config["REALTIME_SETTINGS"]){
+        YAML::Node realtime = config["REALTIME_SETTINGS"];
+
+        if(realtime["ENABLED"])
+            return_config.realtime_enabled = realtime["ENABLED"].as<bool>();
+        if(realtime["LOCK_MEMORY"])
+            return_config.lock_memory = realtime["LOCK_MEMORY"].as<bool>();
+        if(realtime["PREFAULT_HEAP_KB"])
+            return_config.prefault_heap_kb = realtime["PREFAULT_HEAP_KB"].as<int>();
+        if(realtime["PREFAULT_STACK_KB"])
+            return_config.prefault_stack_kb = realtime["PREFAULT_STACK_KB"].as<int>();
+
+        for(auto thread : realtime["THREADS"]){
+            RealtimeThreadSettings settings;
+            if(thread.second["PRIORITY"])
+                settings.priority = thread.second["PRIORITY"].as<int>();
+            if(thread.second["CPU"])
+                settings.cpu = thread.second["CPU"].as<int>();
+            return_config.realtime_threads[thread.first.as<std::string>()] = settings;
+        }
     }
 
     return_config.shader_folder = config["SHADER_FOLDER"].as<std::string>();
 
+    for(YAML::Node playlist_node : config["PLAYLISTS"]){
+        PlaylistConfig playlist;
+        playlist.name = playlist_node["NAME"].as<std::string>();
+        if(playlist_node["SECONDS"])
+            playlist.seconds = playlist_node["SECONDS"].as<float>();
+
+        for(YAML::Node layer_node : playlist_node["LAYERS"]){
+            LayerConfig layer;
+            layer.shader = layer_node["SHADER"].as<std::string>();
+            if(layer_node["BLEND"])
+                layer.blend = layer_node["BLEND"].as<std::string>();
+            if(layer_node["OPACITY"])
+                layer.opacity = layer_node["OPACITY"].as<float>();
+            for(auto define : layer_node["DEFINES"]){
+                layer.defines.emplace_back(define.first.as<std::string>(), define.second.as<std::string>());
+            }
+            playlist.layers.push_back(layer);
+        }
+
+        if(playlist.layers.empty()){
+            throw std::runtime_error("Playlist " + playlist.name + " needs at least one layer.");
+        }
+        return_config.playlists.push_back(playlist);
+    }
+
+    if(config["CROSSFADE_SECONDS"])
+        return_config.crossfade_seconds = config["CROSSFADE_SECONDS"].as<float>();
+
     return return_config;
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+#include "QualityGovernor.h"
+
+// Smoothing of the measured times, so one slow frame doesn't change anything on its own
+#define SMOOTHING 0.1f
+// Audio DSP shouldn't take more than this share of the budget, or the backlog starts to grow
+#define DSP_BUDGET_SHARE 0.5f
+// Hysteresis: step down once the smoothed time has settled over budget, but only step back up after a
+// good while with plenty of headroom
+#define FRAMES_TO_STEP_DOWN 30
+#define FRAMES_TO_STEP_UP 240
+#define HEADROOM 0.6f
+
+bool QualityGovernor::update(float frame_seconds, float dsp_seconds)
+{
+    smoothed_frame_seconds += (frame_seconds - smoothed_frame_seconds) * SMOOTHING;
+    smoothed_dsp_seconds += (dsp_seconds - smoothed_dsp_seconds) * SMOOTHING;
+
+    bool over_budget = smoothed_frame_seconds > budget_seconds || smoothed_dsp_seconds > budget_seconds * DSP_BUDGET_SHARE;
+    bool headroom = smoothed_frame_seconds < budget_seconds * HEADROOM && smoothed_dsp_seconds < budget_seconds * DSP_BUDGET_SHARE * HEADROOM;
+
+    frames_over_budget = over_budget ? frames_over_budget + 1 : 0;
+    frames_with_headroom = headroom ? frames_with_headroom + 1 : 0;
+
+    int new_level = level;
+    if(frames_over_budget >= FRAMES_TO_STEP_DOWN && level < MAX_LEVEL) new_level = level + 1;
+    else if(frames_with_headroom >= FRAMES_TO_STEP_UP && level > 0) new_level = level - 1;
+
+    if(new_level == level) return false;
+
+    level = new_level;
+    frames_over_budget = 0;
+    frames_with_headroom = 0;
+    return true;
+}
+
+const char* QualityGovernor::describe(int level)
+{
+    switch(level){
+    case 0:
+        return "full quality";
+    case 1:
+        return "half render resolution";
+    case 2:
+        return "half render resolution, half audio history";
+    default:
+        return "half render resolution, half audio history, decimated low bands";
+    }
+}
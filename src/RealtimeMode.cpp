@@ -0,0 +1,89 @@
+#include "RealtimeMode.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Touches every page of a stack_bytes sized stack frame, call before the stack is in use
+// Not inlined, so the alloca really extends the stack below the caller's frame and goes away on return
+__attribute__((noinline)) static void prefault_stack(size_t stack_bytes)
+{
+    volatile unsigned char* stack = (volatile unsigned char*) alloca(stack_bytes);
+    long page_size = sysconf(_SC_PAGESIZE);
+    for(size_t i = 0; i < stack_bytes; i += page_size){
+        stack[i] = 0;
+    }
+}
+
+bool RealtimeMode::LockAndPrefaultMemory(bool lock_memory, size_t heap_bytes, size_t stack_bytes)
+{
+    bool success = true;
+
+    if(lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+        fprintf(stderr, "mlockall failed: %s\n", strerror(errno));
+        success = false;
+    }
+
+    // Keep freed memory in the heap instead of handing it back with sbrk/munmap, otherwise the
+    // prefaulted pages are lost as soon as they're freed
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if(heap_bytes > 0){
+        char* heap = (char*) malloc(heap_bytes);
+        if(heap == nullptr){
+            fprintf(stderr, "Failed to prefault %zu bytes of heap\n", heap_bytes);
+            success = false;
+        }
+        else{
+            long page_size = sysconf(_SC_PAGESIZE);
+            for(size_t i = 0; i < heap_bytes; i += page_size){
+                heap[i] = 0;
+            }
+            free(heap);
+        }
+    }
+
+    if(stack_bytes > 0){
+        prefault_stack(stack_bytes);
+    }
+
+    return success;
+}
+
+bool RealtimeMode::ConfigureCurrentThread(const char* name, const RealtimeThreadSettings& settings)
+{
+    bool success = true;
+    pthread_t self = pthread_self();
+
+    pthread_setname_np(self, name);
+
+    if(settings.cpu >= 0){
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(settings.cpu, &cpus);
+        int err = pthread_setaffinity_np(self, sizeof(cpus), &cpus);
+        if(err != 0){
+            fprintf(stderr, "Failed to pin %s thread to CPU %d: %s\n", name, settings.cpu, strerror(err));
+            success = false;
+        }
+    }
+
+    if(settings.priority > 0){
+        sched_param param = {};
+        param.sched_priority = settings.priority;
+        int err = pthread_setschedparam(self, SCHED_FIFO, &param);
+        if(err != 0){
+            fprintf(stderr, "Failed to set SCHED_FIFO priority %d on %s thread: %s\n", settings.priority, name, strerror(err));
+            success = false;
+        }
+    }
+
+    return success;
+}
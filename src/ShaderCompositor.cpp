@@ -0,0 +1,346 @@
+#include "ShaderCompositor.h"
+
+#include <fstream>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "AudioFeatures.h"
+
+// Uniforms the renderer sets, declared once at the top of the generated program instead of once per layer
+static const std::set<std::string> SHARED_UNIFORMS = {
+    "time", "resolution", "audioTexture",
+    "audioLevel", "audioPeak", "audioOnset", "audioBeat", "audioBeatPhase", "audioBpm", "audioCentroid",
+    "audioBands", "audioChannels",
+};
+
+static const std::set<std::string> DECLARATION_QUALIFIERS = {
+    "const", "uniform", "varying", "attribute", "invariant", "highp", "mediump", "lowp",
+};
+
+static std::string blend_function(const std::string& blend)
+{
+    if(blend == "normal") return "_blend_normal";
+    if(blend == "add") return "_blend_add";
+    if(blend == "multiply") return "_blend_multiply";
+    if(blend == "screen") return "_blend_screen";
+    if(blend == "lighten") return "_blend_lighten";
+    throw std::runtime_error("Unknown blend mode " + blend + ", use normal, add, multiply, screen or lighten.");
+}
+
+static std::string strip_comments(const std::string& code)
+{
+    static const std::regex comments("/\\*[\\s\\S]*?\\*/|//[^\\n]*");
+    return std::regex_replace(code, comments, "");
+}
+
+// First identifier in a declarator like "x = 1.0" or "weights[4]"
+static std::string declarator_name(const std::string& declarator)
+{
+    static const std::regex identifier("[A-Za-z_]\\w*");
+    std::smatch match;
+    if(std::regex_search(declarator, match, identifier)) return match.str();
+    return "";
+}
+
+// Names declared at the top level of a shader (functions, globals, structs) so they can be
+// prefixed per layer. Preprocessor lines and function bodies are skipped.
+static std::set<std::string> top_level_names(const std::string& code)
+{
+    std::set<std::string> names;
+    std::string statement;
+    int depth = 0;
+    bool line_start = true, in_directive = false;
+
+    for(char c : code){
+        if(line_start && c == '#') in_directive = true;
+        if(c == '\n'){
+            line_start = true;
+            in_directive = false;
+        }
+        else if(!isspace(c)) line_start = false;
+        if(in_directive) continue;
+
+        if(c == '{'){
+            if(depth++ == 0){
+                // Function definition or struct
+                static const std::regex function_header("([A-Za-z_]\\w*)\\s*\\(");
+                static const std::regex struct_header("\\bstruct\\s+([A-Za-z_]\\w*)");
+                std::smatch match;
+                if(std::regex_search(statement, match, struct_header)){
+                    // Variables can be declared after the body, "struct Wave { ... } waves[3];"
+                    names.insert(match[1].str());
+                    statement = match[1].str() + " ";
+                }
+                else{
+                    if(std::regex_search(statement, match, function_header)) names.insert(match[1].str());
+                    statement.clear();
+                }
+            }
+            continue;
+        }
+        if(c == '}'){
+            depth--;
+            continue;
+        }
+        if(depth > 0) continue;
+
+        if(c != ';'){
+            statement += c;
+            continue;
+        }
+
+        // Declaration, e.g. "const float SPEED = 2.0, SCALE = 1.0" or a prototype "float f(float x)"
+        std::istringstream words(statement);
+        std::string word;
+        while(words >> word && DECLARATION_QUALIFIERS.count(word));
+        std::string rest;
+        std::getline(words, rest);
+
+        if(!word.empty() && word != "precision"){
+            size_t paren = rest.find('('), equals = rest.find('=');
+            if(paren != std::string::npos && (equals == std::string::npos || paren < equals)){
+                names.insert(declarator_name(rest));
+            }
+            else{
+                int nesting = 0;
+                std::string declarator;
+                for(char d : rest + ","){
+                    if(d == '(' || d == '[') nesting++;
+                    if(d == ')' || d == ']') nesting--;
+                    if(d == ',' && nesting == 0){
+                        names.insert(declarator_name(declarator));
+                        declarator.clear();
+                    }
+                    else declarator += d;
+                }
+            }
+        }
+        statement.clear();
+    }
+
+    names.erase("");
+    return names;
+}
+
+// A layer's name for one of its top level names. Names starting with '_' get an extra letter so
+// the result never contains "__", which GLSL ES reserves, and can't collide with another name.
+static std::string prefixed(const std::string& prefix, const std::string& name)
+{
+    return prefix + (name[0] == '_' ? "x" : "_") + name;
+}
+
+// Renames the names in code that isn't inside a struct body. Not after a '.' though, a layer's x
+// or r mustn't rename gl_FragCoord.x or a swizzle; std::regex has no lookbehind, so the character
+// before the name is matched and put back.
+static std::string prefix_names(std::string code, const std::set<std::string>& names, const std::string& prefix)
+{
+    for(const std::string& name : names){
+        code = std::regex_replace(code, std::regex("(^|[^.\\w])" + name + "\\b"), "$1" + prefixed(prefix, name));
+    }
+    return code;
+}
+
+// Renames the names in a struct body, e.g. "vec2 pos; Ripple ripples[COUNT];". Member names stay
+// as they are, since accesses like wave.x can't be renamed, but member types and array sizes that
+// refer to the layer's own structs and constants are renamed.
+static std::string prefix_struct_body(const std::string& body, const std::set<std::string>& names, const std::string& prefix)
+{
+    static const std::regex member("(\\s*(?:(?:highp|mediump|lowp)\\s+)?)(\\w+)([^;]*;)");
+    static const std::regex array_size("\\[[^\\]]*\\]");
+    std::string renamed;
+    auto last = body.cbegin();
+    for(std::sregex_iterator it(body.begin(), body.end(), member), end; it != end; ++it){
+        renamed.append(last, body.cbegin() + it->position());
+        std::string type = (*it)[2].str(), declarators = (*it)[3].str();
+        renamed += (*it)[1].str() + (names.count(type) ? prefixed(prefix, type) : type);
+
+        auto declarator_last = declarators.cbegin();
+        for(std::sregex_iterator size(declarators.begin(), declarators.end(), array_size), size_end; size != size_end; ++size){
+            renamed.append(declarator_last, declarators.cbegin() + size->position());
+            renamed += prefix_names(size->str(), names, prefix);
+            declarator_last = declarators.cbegin() + size->position() + size->length();
+        }
+        renamed.append(declarator_last, declarators.cend());
+        last = body.cbegin() + it->position() + it->length();
+    }
+    renamed.append(last, body.cend());
+    return renamed;
+}
+
+ShaderCompositor::ShaderCompositor(OpenGLEDConfig& config)
+    : playlists(config.playlists), shader_folder(config.shader_folder), crossfade_seconds(config.crossfade_seconds)
+{
+}
+
+std::string ShaderCompositor::layer_function(const LayerConfig& layer, const std::string& prefix)
+{
+    std::ifstream file(shader_folder + "/" + layer.shader);
+    if(!file){
+        throw std::runtime_error("Could not read layer shader " + layer.shader + " in " + shader_folder);
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+    std::string code = strip_comments(source.str());
+
+    // Shared uniforms are already declared, and precision/version come from the generated header.
+    // Nothing would ever set any other uniform, so those are an error rather than a silent 0.
+    static const std::regex uniform("\\buniform\\s+(?:(?:highp|mediump|lowp)\\s+)?\\w+\\s+(\\w+)\\s*(?:\\[[^\\]]*\\])?\\s*;");
+    static const std::regex header_statements("\\bprecision\\s+\\w+\\s+\\w+\\s*;|#version[^\\n]*");
+    for(std::sregex_iterator it(code.begin(), code.end(), uniform), end; it != end; ++it){
+        if(!SHARED_UNIFORMS.count((*it)[1].str())){
+            throw std::runtime_error("Layer shader " + layer.shader + " declares uniform " + (*it)[1].str() +
+                                     ", which the renderer doesn't set. Use a constant and DEFINES instead.");
+        }
+    }
+    code = std::regex_replace(code, uniform, "");
+    code = std::regex_replace(code, header_statements, "");
+
+    // Prefix everything this layer declares, including main, so layers can share the program.
+    // Struct bodies are renamed separately so their member names stay untouched.
+    std::set<std::string> names = top_level_names(code);
+    static const std::regex struct_body("\\bstruct\\s*\\w*\\s*\\{([^}]*)\\}");
+    std::string renamed;
+    auto last = code.cbegin();
+    for(std::sregex_iterator it(code.begin(), code.end(), struct_body), end; it != end; ++it){
+        auto body_start = code.cbegin() + it->position(1), body_end = body_start + it->length(1);
+        renamed += prefix_names(std::string(last, body_start), names, prefix);
+        renamed += prefix_struct_body(std::string(body_start, body_end), names, prefix);
+        last = body_end;
+    }
+    renamed += prefix_names(std::string(last, code.cend()), names, prefix);
+    code = std::regex_replace(renamed, std::regex("\\bgl_FragColor\\b"), "_layer_color");
+
+    // Specialize the layer's constants, and undo them (and its own macros) after it
+    std::string defines, undefines;
+    std::set<std::string> macros;
+    for(const auto& [name, value] : layer.defines){
+        defines += "#define " + name + " " + value + "\n";
+        macros.insert(name);
+    }
+    static const std::regex own_macro("#\\s*define\\s+(\\w+)");
+    for(std::sregex_iterator it(code.begin(), code.end(), own_macro), end; it != end; ++it){
+        macros.insert((*it)[1].str());
+    }
+    for(const std::string& macro : macros){
+        undefines += "#undef " + macro + "\n";
+    }
+
+    return "// Layer " + layer.shader + "\n" + defines + code + "\n" + undefines;
+}
+
+std::string ShaderCompositor::generate_fragment_shader()
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+
+    out << "#ifdef GL_ES\n"
+           "precision mediump float;\n"
+           "#endif\n\n"
+           "uniform float time;\n"
+           "uniform vec2 resolution;\n"
+           "uniform sampler2D audioTexture;\n"
+           "uniform float audioLevel[" << MAX_AUDIO_FEATURE_BANDS << "];\n"
+           "uniform float audioPeak[" << MAX_AUDIO_FEATURE_BANDS << "];\n"
+           "uniform float audioOnset[" << MAX_AUDIO_FEATURE_BANDS << "];\n"
+           "uniform float audioBeat;\n"
+           "uniform float audioBeatPhase;\n"
+           "uniform float audioBpm;\n"
+           "uniform float audioCentroid;\n"
+           "uniform float audioBands;\n"
+           "uniform float audioChannels;\n\n"
+           "uniform int playlistA;\n"
+           "uniform int playlistB;\n"
+           "uniform float playlistFade;\n\n"
+           "vec4 _layer_color;\n\n"
+           "vec3 _blend_normal(vec3 base, vec4 layer, float opacity){ return mix(base, layer.rgb, opacity * layer.a); }\n"
+           "vec3 _blend_add(vec3 base, vec4 layer, float opacity){ return base + layer.rgb * opacity * layer.a; }\n"
+           "vec3 _blend_multiply(vec3 base, vec4 layer, float opacity){ return mix(base, base * layer.rgb, opacity * layer.a); }\n"
+           "vec3 _blend_screen(vec3 base, vec4 layer, float opacity){ return mix(base, 1.0 - (1.0 - base) * (1.0 - layer.rgb), opacity * layer.a); }\n"
+           "vec3 _blend_lighten(vec3 base, vec4 layer, float opacity){ return mix(base, max(base, layer.rgb), opacity * layer.a); }\n\n";
+
+    for(size_t p = 0; p < playlists.size(); p++){
+        std::ostringstream composite;
+        composite.setf(std::ios::fixed);
+        composite << "vec3 _playlist_" << p << "(){\n"
+                     "    vec3 color = vec3(0.0);\n";
+
+        for(size_t l = 0; l < playlists[p].layers.size(); l++){
+            const LayerConfig& layer = playlists[p].layers[l];
+            std::string prefix = "_p" + std::to_string(p) + "l" + std::to_string(l);
+
+            out << layer_function(layer, prefix) << "\n";
+            composite << "    _layer_color = vec4(0.0, 0.0, 0.0, 1.0);\n"
+                         "    " << prefixed(prefix, "main") << "();\n"
+                         "    color = " << blend_function(layer.blend) << "(color, _layer_color, " << layer.opacity << ");\n";
+        }
+
+        composite << "    return color;\n"
+                     "}\n\n";
+        out << composite.str();
+    }
+
+    // Only the playlists that are playing or fading in get evaluated
+    out << "void main(){\n"
+           "    vec3 color = vec3(0.0);\n";
+    for(size_t p = 0; p < playlists.size(); p++){
+        out << "    if(playlistA == " << p << " || playlistB == " << p << "){\n"
+               "        float weight = (playlistA == " << p << " ? 1.0 - playlistFade : 0.0) + (playlistB == " << p << " ? playlistFade : 0.0);\n"
+               "        color += _playlist_" << p << "() * weight;\n"
+               "    }\n";
+    }
+    out << "    gl_FragColor = vec4(color, 1.0);\n"
+           "}\n";
+
+    return out.str();
+}
+
+void ShaderCompositor::switch_to(int playlist, float now)
+{
+    if(playlist < 0 || playlist >= (int) playlists.size()) return;
+
+    // The program only blends two playlists, so a switch during a fade waits for that fade to
+    // finish instead of cutting it short. Only the latest one waits.
+    if(next >= 0){
+        queued = playlist == next ? -1 : playlist;
+        return;
+    }
+    if(playlist == current) return;
+    next = playlist;
+    crossfade_started = now;
+}
+
+void ShaderCompositor::upload(GLuint program, float now)
+{
+    if(program != this->program){
+        this->program = program;
+        playlist_a_location = glGetUniformLocation(program, "playlistA");
+        playlist_b_location = glGetUniformLocation(program, "playlistB");
+        playlist_fade_location = glGetUniformLocation(program, "playlistFade");
+    }
+
+    if(next < 0 && playlists[current].seconds > 0 && now - playlist_started >= playlists[current].seconds){
+        switch_to((current + 1) % playlists.size(), now);
+    }
+
+    float fade = 0;
+    if(next >= 0){
+        fade = crossfade_seconds > 0 ? (now - crossfade_started) / crossfade_seconds : 1.f;
+        if(fade >= 1.f){
+            current = next;
+            next = -1;
+            fade = 0;
+            playlist_started = now;
+            if(queued >= 0){
+                int playlist = queued;
+                queued = -1;
+                switch_to(playlist, now);
+            }
+        }
+    }
+
+    glUniform1i(playlist_a_location, current);
+    glUniform1i(playlist_b_location, next);
+    glUniform1f(playlist_fade_location, fade);
+}
@@ -0,0 +1,44 @@
+#include "TimingStats.h"
+
+#include <algorithm>
+
+TimingStats::TimingStats(std::string name, int capacity) : name(name)
+{
+    samples.resize(capacity);
+    sorted_scratch.resize(capacity);
+}
+
+void TimingStats::record(int64_t nanoseconds)
+{
+    samples[next] = nanoseconds;
+    next = (next + 1) % samples.size();
+    if(count < (int) samples.size()) count++;
+    max_seen = std::max(max_seen, nanoseconds);
+}
+
+int64_t TimingStats::percentile(double p)
+{
+    if(count == 0) return 0;
+
+    // Samples are stored in a ring, but only the first count of them are valid until it wraps
+    std::copy(samples.begin(), samples.begin() + count, sorted_scratch.begin());
+    int index = std::min(count - 1, (int) (p / 100.0 * count));
+    std::nth_element(sorted_scratch.begin(), sorted_scratch.begin() + index, sorted_scratch.begin() + count);
+    return sorted_scratch[index];
+}
+
+void TimingStats::clear()
+{
+    next = 0;
+    count = 0;
+    max_seen = 0;
+}
+
+void TimingStats::report(std::ostream& out)
+{
+    out << name << ": n=" << count
+        << " p50=" << percentile(50.0) / 1000 << "us"
+        << " p99=" << percentile(99.0) / 1000 << "us"
+        << " p99.9=" << percentile(99.9) / 1000 << "us"
+        << " max=" << max_seen / 1000 << "us\n";
+}
@@ -1,10 +1,13 @@
 #include <iostream>
 #include <vector>
+#include <deque>
 #include <set>
 #include <memory>
 #include <filesystem>
 #include <regex>
 #include <string>
+#include <thread>
+#include <atomic>
 #include <ctime>
 #include <stdint.h>
 #include <csignal>
@@ -16,17 +19,27 @@
 
 #include "ws2811.h"
 #include "RaspiHeadlessOpenGLContext.h"
-#include "Iir.h"
 #include "args.h"
 #define DR_WAV_IMPLEMENTATION
 #include "dr_wav.h"
 
+#include "AllocationCounter.h"
+#include "AudioAnalyzer.h"
+#include "AudioFeatures.h"
+#include "AudioSource.h"
 #include "CircularBuffer.h"
+#include "ControlPlane.h"
+#include "FrameExport.h"
+#include "FramebufferRing.h"
+#include "FrameQueue.h"
 #include "OpenGLEDConfig.h"
+#include "QualityGovernor.h"
+#include "RealtimeMode.h"
 #include "Shader.h"
+#include "ShaderCompositor.h"
+#include "TimingStats.h"
 
 #define STRIP_TYPE WS2811_STRIP_GBR // 00 BB GG RR
-#define FILTER_ORDER 2
 
 const GLfloat FULLSCREEN_BOX_VEC2[] = {
   -1, -1,
@@ -42,10 +55,10 @@ const GLfloat FULLSCREEN_BOX_VEC2[] = {
 static const char* DEFAULT_VERTEX_SHADER = STRINGIFY(
     attribute vec2 pos; void main() { gl_Position = vec4(pos, 0.0, 1.0); });
 
-static uint8_t running = 1;
+static std::atomic<bool> running(true);
 
 static void ctrl_c_handler(int signum){
-  running = 0;
+  running = false;
 }
 
 static void setup_handlers(void){
@@ -83,20 +96,124 @@ float seconds_elapsed(timespec start, timespec end){
   return (float) ns_elapsed / 1000000000.f;
 }
 
-float convertS16LEToFloat(const char sample[2]) {
-    // Step 1: Combine the two bytes into a signed 16-bit integer
-    int16_t intSample = (static_cast<int16_t>(static_cast<uint8_t>(sample[1])) << 8) |
-                        static_cast<uint8_t>(sample[0]);
+int64_t nanoseconds_elapsed(timespec start, timespec end){
+  return (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+}
+
+const float JITTER_REPORT_SECONDS = 5.f;
+
+struct LedOutputOptions{
+  bool debug_jitter = false;
+  bool debug_latency = false;
+  bool simulate = false; // Loopback mode: no strip attached, just wait as long as sending would take
+};
+
+// Runs on its own thread so the strip clocks out frame N while the render thread works on frame N+1
+ws2811_return_t led_output_loop(ws2811_t* ledstring, FrameQueue* frame_queue, FrameExport* frame_export, const OpenGLEDConfig* config, LedOutputOptions options){
+  ws2811_return_t ret = WS2811_SUCCESS;
+  TimingStats wakeup_stats("output thread wake-up latency");
+  TimingStats queue_delay_stats("output queue delay (submit to dequeue)");
+  TimingStats latency_stats("audio-to-light latency");
+  TimingStats click_latency_stats("loopback click-to-light latency");
+  timespec last_jitter_report, last_latency_report;
+  clock_gettime(CLOCK_MONOTONIC, &last_jitter_report);
+  last_latency_report = last_jitter_report;
+
+  int num_leds = config->width * config->height;
+  vector<ws2811_led_t> simulated_leds(options.simulate ? num_leds : 0);
+  ws2811_led_t* leds = options.simulate ? simulated_leds.data() : ledstring->channel[0].leds;
+
+  int64_t wake_latency_ns;
+  while(LedFrame* frame = frame_queue->acquire_ready(&wake_latency_ns)){
+
+    if(options.debug_jitter){
+      timespec woke;
+      clock_gettime(CLOCK_MONOTONIC, &woke);
+      // Only frames the thread slept for tell how fast it was scheduled, the queue delay also
+      // includes waiting behind the previous frame's transfer
+      if(wake_latency_ns >= 0) wakeup_stats.record(wake_latency_ns);
+      queue_delay_stats.record(nanoseconds_elapsed(frame->submitted, woke));
+
+      if(seconds_elapsed(last_jitter_report, woke) >= JITTER_REPORT_SECONDS){
+        wakeup_stats.report(cout);
+        wakeup_stats.clear();
+        queue_delay_stats.report(cout);
+        queue_delay_stats.clear();
+        last_jitter_report = woke;
+      }
+    }
+
+    // Don't touch the LED buffer while the previous frame is still being sent
+    if(!options.simulate){
+      ws2811_wait(ledstring);
+      ledstring->channel[0].brightness = frame->brightness;
+    }
+
+    // Copy from buffer to LEDs, scaling up with nearest neighbour if the frame was drawn smaller
+
+    bool full_size = frame->render_width == config->width && frame->render_height == config->height;
+    for(int y = 0; y < config->height; y++){
+      int source_y = full_size ? y : y * frame->render_height / config->height;
+      for(int x = 0; x < config->width; x++){
+        int source_x = full_size ? x : x * frame->render_width / config->width;
+        unsigned char* pixel = &frame->pixels[(source_y * frame->render_width + source_x) * 4];
+
+        // Convert a pixel e.g. RR GG BB AA into 0x00BBGGRR
+        leds[y * config->width + x] = (pixel[2] << 16) | (pixel[1] << 8) | pixel[0];
+      }
+    }
+
+    // The previous transfer is done, so the DMA for this frame starts right after this
+    timespec sent;
+    clock_gettime(CLOCK_MONOTONIC, &sent);
+
+    if(frame_export){
+      frame_export->publish(leds, frame->bands.data(), frame->brightness, frame->quality_level, sent);
+    }
+
+    if(frame->has_new_audio){
+      latency_stats.record(nanoseconds_elapsed(frame->audio_captured, sent));
+    }
+    if(frame->shows_click){
+      click_latency_stats.record(nanoseconds_elapsed(frame->click_captured, sent));
+    }
+
+    if(options.debug_latency && seconds_elapsed(last_latency_report, sent) >= JITTER_REPORT_SECONDS){
+      latency_stats.report(cout);
+      latency_stats.clear();
+      if(options.simulate){
+        click_latency_stats.report(cout);
+        click_latency_stats.clear();
+      }
+      last_latency_report = sent;
+    }
+
+    frame_queue->release(frame);
 
-    // Step 2: Normalize to the range [-1.0, 1.0]
-    return intSample / 32768.0f; // 32768 is 2^15, the maximum absolute value for int16_t
+    if(options.simulate){
+      // 24 bits at 800kHz per LED, plus the latch time
+      usleep(num_leds * 30 + 300);
+    }
+    else if((ret = ws2811_render(ledstring)) != WS2811_SUCCESS){
+      cerr << "ws2811_render failed: " << ws2811_get_return_t_str(ret) << "\n";
+      running = false;
+      frame_queue->close(); // Don't leave the render thread waiting on a free frame
+      break;
+    }
+  }
+
+  return ret;
 }
 
 int main(int argc, char* argv[]){
 
   // Check args to see if we are debugging or something
-  args::ArgParser arg_parser("Usage: open_gled [--debug-audio]", "1.0");
+  args::ArgParser arg_parser("Usage: open_gled [--debug-audio] [--debug-jitter] [--debug-latency] [--debug-allocations] [--latency-loopback]", "1.0");
   arg_parser.flag("debug-audio");
+  arg_parser.flag("debug-jitter");
+  arg_parser.flag("debug-latency");
+  arg_parser.flag("debug-allocations"); // Needs a build with OPENGLED_COUNT_ALLOCATIONS
+  arg_parser.flag("latency-loopback"); // Synthetic clicks in, no LEDs out, to check the latency numbers without hardware
 
   arg_parser.parse(argc, argv);
 
@@ -125,45 +242,54 @@ int main(int argc, char* argv[]){
   // Setup mic debugging
 
   const int NUM_FRAMES_TO_RECORD_DEBUG = 256;
-  vector<char> wav_samples;
-  vector<vector<char>> wav_band_samples;
+  vector<float> wav_samples;
+  vector<vector<float>> wav_band_samples;
+  vector<float*> wav_band_pointers;
   int buffers_written = 0;
   if(arg_parser.found("debug-audio")){
     cout << "Debugging audio..." << "\n";
-    wav_samples.resize(NUM_FRAMES_TO_RECORD_DEBUG * config.samples_per_pixel * 4);
-    for(int b = 0; b < config.num_bands(); b++){
-      wav_band_samples.emplace_back(NUM_FRAMES_TO_RECORD_DEBUG * config.samples_per_pixel * 4);
+    wav_samples.resize(NUM_FRAMES_TO_RECORD_DEBUG * config.samples_per_pixel);
+    for(int row = 0; row < config.analysis_channels() * config.num_bands(); row++){
+      wav_band_samples.emplace_back(NUM_FRAMES_TO_RECORD_DEBUG * config.samples_per_pixel);
     }
+    wav_band_pointers.resize(wav_band_samples.size());
   }
 
   // Setup microphone processing
 
-  unique_ptr<ALSACaptureDevice> microphone;
+  unique_ptr<AudioSource> microphone;
+  ClickAudioSource* click_source = nullptr;
   vector<char> microphone_buffer;
 
-  vector<Iir::Butterworth::BandPass<FILTER_ORDER>> band_filters;
-  vector<float> filtered_samples;
-  vector<CircularBuffer<unsigned char>> band_pixel_buffers;
-  vector<unsigned char> audio_reactive_texture_data;
+  unique_ptr<AudioAnalyzer> audio_analyzer;
   GLuint audio_reactive_texture;
+  unique_ptr<AudioFeatureExtractor> audio_features;
 
-  if(config.alsa_input_device != ""){
-    microphone = make_unique<ALSACaptureDevice>(config.alsa_input_device, config.sample_rate, 1, config.samples_per_pixel, SND_PCM_FORMAT_S16_LE);
-    microphone_buffer.resize(microphone->get_bytes_per_frame() * microphone->get_frames_per_period());
-    microphone->open();
+  bool loopback = arg_parser.found("latency-loopback");
+  if(loopback){
+    auto clicks = make_unique<ClickAudioSource>(config.sample_rate, config.channels);
+    click_source = clicks.get();
+    microphone = move(clicks);
+  }
+  else if(config.alsa_input_device != ""){
+    microphone = make_unique<ALSAAudioSource>(config.alsa_input_device, config.sample_rate, config.channels, config.samples_per_pixel);
+  }
 
-    for(int band = 0; band < config.num_bands(); band++){
-      band_filters.emplace_back();
-      band_filters[band].setup(config.sample_rate, config.center_frequency(band), config.band_width(band));
-      band_pixel_buffers.emplace_back(config.pixels_per_band);
+  if(microphone){
+    // Room for the largest backlog batch, read in one capture call
+    microphone_buffer.resize(microphone->bytes_per_frame() * config.samples_per_pixel * config.max_backlog_blocks);
+    if(!microphone->open()){
+      cerr << "Failed to open audio input " << config.alsa_input_device << ".\n";
+      return 1;
     }
 
-    filtered_samples.resize(config.samples_per_pixel);
-    audio_reactive_texture_data.resize(config.pixels_per_band * config.num_bands(), 0);
+    audio_analyzer = make_unique<AudioAnalyzer>(config);
+    audio_features = make_unique<AudioFeatureExtractor>(config);
 
     glGenTextures(1, &audio_reactive_texture);
     glBindTexture(GL_TEXTURE_2D, audio_reactive_texture); // This needs to be called every time if you use any other texture
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Rows are history() bytes, which can be any length
   }
 
   // Clear whole screen (front buffer)
@@ -173,29 +299,45 @@ int main(int argc, char* argv[]){
 
   // Load shaders from the shader folder
 
-  vector<Shader> shaders;
+  deque<Shader> shaders; // Not a vector, growing it would copy and destroy the programs
   
-  for (const auto & file : fs::directory_iterator(config.shader_folder)){
+  unique_ptr<ShaderCompositor> compositor;
+
+  if(!config.playlists.empty()){
+    // Build every playlist's layers into one program so they render in a single pass
+    compositor = make_unique<ShaderCompositor>(config);
+    try{
+      string shaderCode = compositor->generate_fragment_shader();
+      shaders.emplace_back(DEFAULT_VERTEX_SHADER, shaderCode.c_str());
+    }
+    catch(runtime_error& e){
+      cerr << "Failed to build playlists: " << e.what() << "\n";
+      return 1;
+    }
+  }
+  else{
+    for (const auto & file : fs::directory_iterator(config.shader_folder)){
 
-    if(file.path().extension() == ".fs"){
+      if(file.path().extension() == ".fs"){
 
-      string shaderCode = read_file(file.path());
+        string shaderCode = read_file(file.path());
 
-      /*if(config.gamma_correction != 1.0){
-        // Hotpatch the fragment shader with gamma correction:
-        //  e.g. gl_FragColor = pow(gl_FragColor, vec4(1.7, 1.7, 1.7, 1));
-        regex fragment_main_function_regex("void\\s+main\\s*\\(\\s*\\)\\s*\\{([^\\}]*)\\}");
-        shaderCode = regex_replace(shaderCode, fragment_main_function_regex, "void main(){$1\n\tgl_FragColor = pow(gl_FragColor, vec4("
-          + to_string(config.gamma_correction)
-          + "," + to_string(config.gamma_correction)
-          + "," + to_string(config.gamma_correction)
-          + ",1));\n}");
+        /*if(config.gamma_correction != 1.0){
+          // Hotpatch the fragment shader with gamma correction:
+          //  e.g. gl_FragColor = pow(gl_FragColor, vec4(1.7, 1.7, 1.7, 1));
+          regex fragment_main_function_regex("void\\s+main\\s*\\(\\s*\\)\\s*\\{([^\\}]*)\\}");
+          shaderCode = regex_replace(shaderCode, fragment_main_function_regex, "void main(){$1\n\tgl_FragColor = pow(gl_FragColor, vec4("
+            + to_string(config.gamma_correction)
+            + "," + to_string(config.gamma_correction)
+            + "," + to_string(config.gamma_correction)
+            + ",1));\n}");
 
-        cout << shaderCode << "\n"; // debug
-      }*/
+          cout << shaderCode << "\n"; // debug
+        }*/
 
-      shaders.emplace_back(DEFAULT_VERTEX_SHADER, shaderCode.c_str()); // Have to be careful with copies since the shader destroys on deconstruct
+        shaders.emplace_back(DEFAULT_VERTEX_SHADER, shaderCode.c_str()); // Have to be careful with copies since the shader destroys on deconstruct
       
+      }
     }
   }
 
@@ -204,9 +346,6 @@ int main(int argc, char* argv[]){
     return 1;
   }
 
-  int current_shader = 0;
-  shaders[current_shader].use();
-
   // Setup the full screen VBO
 
   GLuint vbo;
@@ -214,23 +353,71 @@ int main(int argc, char* argv[]){
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glBufferData(GL_ARRAY_BUFFER, 12 * sizeof(GLfloat), FULLSCREEN_BOX_VEC2, GL_STATIC_DRAW);
 
-  GLint posLoc = glGetAttribLocation(shaders[current_shader].ID, "pos"); // Also do this for the other shaders
-  glEnableVertexAttribArray(posLoc);
-  glVertexAttribPointer(posLoc, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
-
   // Get uniforms
 
   timespec clock_start;
   clock_gettime(CLOCK_MONOTONIC, &clock_start);
-  GLint timeLoc = glGetUniformLocation(shaders[current_shader].ID, "time"); // Also do this for the other shaders
+  int current_shader = 0;
+  GLint timeLoc, resolutionLoc;
+  int render_width = config.width, render_height = config.height;
 
   // Do this whole thing on shader initialization
-  GLint resolutionLoc = glGetUniformLocation(shaders[current_shader].ID, "resolution");
-  glUniform2f(resolutionLoc, (GLfloat) config.width, (GLfloat) config.height);
+  auto use_shader = [&](int index){
+    current_shader = index;
+    shaders[current_shader].use();
+
+    GLint posLoc = glGetAttribLocation(shaders[current_shader].ID, "pos");
+    glEnableVertexAttribArray(posLoc);
+    glVertexAttribPointer(posLoc, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+
+    timeLoc = glGetUniformLocation(shaders[current_shader].ID, "time");
+    resolutionLoc = glGetUniformLocation(shaders[current_shader].ID, "resolution");
+    glUniform2f(resolutionLoc, (GLfloat) render_width, (GLfloat) render_height);
+  };
+  use_shader(0);
+
+  // Setup the control plane so parameters can be changed while running
 
-  // Setup buffer to copy pixel data to LEDs
+  uint8_t brightness = config.brightness;
 
-  vector<char> led_buffer(config.width * config.height * 3);
+  ControlParameters control_params = {};
+  control_params.brightness = config.brightness;
+  control_params.shader = current_shader;
+  control_params.pregain = config.pregain;
+  control_params.sample_rate = config.sample_rate;
+  if(config.frequency_bands.size() <= CONTROL_MAX_BANDS + 1){
+    control_params.num_band_cutoffs = config.frequency_bands.size();
+    copy(config.frequency_bands.begin(), config.frequency_bands.end(), control_params.band_cutoffs);
+  }
+
+  unique_ptr<ControlPlane> control;
+  if(config.control_shm_name != ""){
+    control = make_unique<ControlPlane>(config.control_shm_name, true, config.control_group);
+    if(!control->Initialize(&control_params)){
+      cerr << "Failed to create the control plane, parameters can't be changed while running.\n";
+      control.reset();
+    }
+  }
+
+  // Setup offscreen targets and the buffers to copy pixel data to LEDs
+
+  FramebufferRing frame_targets(config.width, config.height, config.pipeline_depth);
+  if(!frame_targets.Initialize()){
+    cerr << "Failed to create offscreen framebuffers.\n";
+    return 1;
+  }
+
+  int band_rows = config.analysis_channels() * config.num_bands();
+  FrameQueue frame_queue(config.pipeline_depth, config.width * config.height * 4, band_rows);
+
+  unique_ptr<FrameExport> frame_export;
+  if(config.frame_export_shm_name != ""){
+    frame_export = make_unique<FrameExport>(config.frame_export_shm_name, config.width, config.height, band_rows, config.frame_export_slots);
+    if(!frame_export->Initialize()){
+      cerr << "Failed to create the frame export ring, frames won't be visible to other processes.\n";
+      frame_export.reset();
+    }
+  }
 
   // Setup LED strip
 
@@ -258,62 +445,184 @@ int main(int argc, char* argv[]){
     },
   };
 
-  ws2811_return_t ret;
+  ws2811_return_t ret = WS2811_SUCCESS;
 
-  if((ret = ws2811_init(&ledstring)) != WS2811_SUCCESS){
+  if(!loopback && (ret = ws2811_init(&ledstring)) != WS2811_SUCCESS){
     cerr << "ws2811_init failed: " << ws2811_get_return_t_str(ret) << "\n";
     return ret;
   }
 
+  // Realtime mode, done last so the prefaulted heap isn't eaten by setup allocations
+
+  if(config.realtime_enabled){
+    RealtimeMode::LockAndPrefaultMemory(config.lock_memory, config.prefault_heap_kb * 1024, config.prefault_stack_kb * 1024);
+    // Audio capture currently runs on the render thread too
+    RealtimeMode::ConfigureCurrentThread("render", config.realtime_threads["RENDER"]);
+  }
+
+  ws2811_return_t output_ret = WS2811_SUCCESS;
+  thread led_output_thread([&]{
+    if(config.realtime_enabled){
+      RealtimeMode::ConfigureCurrentThread("output", config.realtime_threads["OUTPUT"]);
+    }
+    LedOutputOptions options;
+    options.debug_jitter = arg_parser.found("debug-jitter");
+    options.debug_latency = arg_parser.found("debug-latency") || loopback;
+    options.simulate = loopback;
+    output_ret = led_output_loop(&ledstring, &frame_queue, frame_export.get(), &config, options);
+  });
+
+  // Audio capture times and band levels of what's drawn into each offscreen target, so they follow the frame through the pipeline
+
+  struct DrawnAudio{
+    bool has_new_audio = false;
+    timespec audio_captured = {};
+    bool shows_click = false;
+    timespec click_captured = {};
+  };
+  vector<DrawnAudio> drawn_audio(config.pipeline_depth);
+  vector<vector<float>> drawn_bands(config.pipeline_depth, vector<float>(band_rows));
+  DrawnAudio pending_audio;
+
+  // Quality governor, trades render resolution and analysis detail for frame time when the Pi can't keep up
+
+  unique_ptr<QualityGovernor> governor;
+  if(config.quality_governor){
+    governor = make_unique<QualityGovernor>(config.frame_budget_ms / 1000.f);
+  }
+
+  auto apply_quality = [&](){
+    render_width = governor->half_resolution() ? max(1, config.width / 2) : config.width;
+    render_height = governor->half_resolution() ? max(1, config.height / 2) : config.height;
+    frame_targets.set_render_size(render_width, render_height);
+    glUniform2f(resolutionLoc, (GLfloat) render_width, (GLfloat) render_height);
+
+    if(audio_analyzer){
+      audio_analyzer->set_history_length(governor->half_audio_history() ? config.pixels_per_band / 2 : config.pixels_per_band);
+      audio_analyzer->set_decimation(governor->decimated_analysis());
+    }
+
+    cout << "Quality level " << governor->quality_level() << " (" << QualityGovernor::describe(governor->quality_level()) << "), frame time "
+      << governor->frame_seconds() * 1000.f << "ms, audio " << governor->dsp_seconds() * 1000.f << "ms\n";
+  };
+
+  // Allocation check, the render loop should stop allocating once the first frames are through the pipeline
+
+  bool debug_audio = arg_parser.found("debug-audio");
+  bool debug_allocations = arg_parser.found("debug-allocations");
+  if(debug_allocations && !AllocationCounter::enabled()){
+    cerr << "--debug-allocations needs a build with -DOPENGLED_COUNT_ALLOCATIONS=ON, ignoring it.\n";
+    debug_allocations = false;
+  }
+  long frames_rendered = 0, frames_counted = 0;
+  unsigned long audio_allocations = 0, loop_allocations = 0;
+
+  // Jitter monitor
+
+  TimingStats render_period_stats("render loop period");
+  TimingStats render_wakeup_stats("render thread wake-up latency");
+  timespec last_loop_start, last_jitter_report;
+  clock_gettime(CLOCK_MONOTONIC, &last_loop_start);
+  last_jitter_report = last_loop_start;
+  timespec last_allocation_report = last_loop_start;
+
   while(running){
 
+    timespec loop_start;
+    clock_gettime(CLOCK_MONOTONIC, &loop_start);
+
+    if(arg_parser.found("debug-jitter")){
+      render_period_stats.record(nanoseconds_elapsed(last_loop_start, loop_start));
+      last_loop_start = loop_start;
+
+      if(seconds_elapsed(last_jitter_report, loop_start) >= JITTER_REPORT_SECONDS){
+        render_period_stats.report(cout);
+        render_period_stats.clear();
+        render_wakeup_stats.report(cout);
+        render_wakeup_stats.clear();
+        last_jitter_report = loop_start;
+      }
+    }
+
+    unsigned long loop_allocations_before = AllocationCounter::allocations_on_this_thread();
+
+    // Pick up parameter changes, just an atomic load unless something was published
+
+    if(control && control->poll(control_params)){
+      brightness = clamp(control_params.brightness, 0, 255);
+      if(audio_analyzer && ControlPlane::ValidPregain(control_params.pregain)){
+        audio_analyzer->pregain = control_params.pregain;
+      }
+
+      if(compositor){
+        timespec clock_now;
+        clock_gettime(CLOCK_MONOTONIC, &clock_now);
+        compositor->switch_to(control_params.shader, seconds_elapsed(clock_start, clock_now));
+      }
+      else if(control_params.shader != current_shader && control_params.shader >= 0 && control_params.shader < (int) shaders.size()){
+        use_shader(control_params.shader);
+      }
+
+      // Redesigning the filters from bad cutoffs would throw or give negative band widths, so those are ignored
+      string cutoff_error;
+      if(audio_analyzer && control_params.num_band_cutoffs == (int) config.frequency_bands.size()
+          && !equal(control_params.band_cutoffs, control_params.band_cutoffs + control_params.num_band_cutoffs, config.frequency_bands.begin())){
+        if(ControlPlane::ValidBandCutoffs(control_params.band_cutoffs, control_params.num_band_cutoffs, config.sample_rate, &cutoff_error)){
+          copy(control_params.band_cutoffs, control_params.band_cutoffs + control_params.num_band_cutoffs, config.frequency_bands.begin());
+          audio_analyzer->setup_filters(config);
+        }
+        else{
+          cerr << "Ignoring new band cutoffs: " << cutoff_error << "\n";
+        }
+      }
+    }
+
     // Calculate shader audio texture
 
+    timespec dsp_start, dsp_end;
+    clock_gettime(CLOCK_MONOTONIC, &dsp_start);
+    dsp_end = dsp_start;
+
     if(microphone){
-      while(microphone->samples_left_to_read() >= config.samples_per_pixel){
-        microphone->capture_into_buffer(microphone_buffer.data(), config.samples_per_pixel);
+      unsigned long audio_allocations_before = AllocationCounter::allocations_on_this_thread();
+
+      // Read everything that's queued up in as few capture calls as the buffer allows, so falling
+      // behind by a few blocks costs one batch instead of the whole per-block path for each
+      long blocks_ready;
+      while(running && (blocks_ready = microphone->samples_left_to_read() / config.samples_per_pixel) > 0){
+        int blocks = (int) min(blocks_ready, (long) audio_analyzer->max_batch_blocks());
+        if(debug_audio){
+          blocks = min(blocks, NUM_FRAMES_TO_RECORD_DEBUG - buffers_written);
+        }
+        microphone->capture_into_buffer(microphone_buffer.data(), blocks * config.samples_per_pixel);
 
         // Filter mic signal into bands
 
-        for(int band = 0; band < config.num_bands(); band++){
-          // Filter current buffer
-          for(int s = 0; s < config.samples_per_pixel; s++){
-            // S16_LE one channel -> float  !! ASSUMES ONE CHANNEL
-            filtered_samples[s] = convertS16LEToFloat(microphone_buffer.data() + 2*s);
-            // Filter
-            filtered_samples[s] = band_filters[band].filter(filtered_samples[s]);
-          }
-
+        if(debug_audio){
           // MIC DEBUGGING FOR BAND PROCESSING
-          if(arg_parser.found("debug-audio")){
-            memcpy(wav_band_samples[band].data() + config.samples_per_pixel * 4 * buffers_written, filtered_samples.data(), config.samples_per_pixel * 4);
-          }
-
-          // Calculate brightness of next pixel from db RMS
-          double sum = 0;
-          for(int s = 0; s < config.samples_per_pixel; s++){
-            sum += filtered_samples[s] * filtered_samples[s];
+          for(size_t row = 0; row < wav_band_samples.size(); row++){
+            wav_band_pointers[row] = wav_band_samples[row].data() + config.samples_per_pixel * buffers_written;
           }
-          // This rms measurement seems to just be garbage data? not correlated with the volume at all
-          double rms = sqrt(sum / config.samples_per_pixel) * 50.0; // 50.0 is temporary pregain
-
-          //cout << "band " << band << ": " << rms << "\n";
-
-          band_pixel_buffers[band].push_back((unsigned char) (rms * 255.5)); // .5 so it rounds correctly
+          audio_analyzer->process_batch(microphone_buffer.data(), blocks, wav_band_pointers.data());
+        }
+        else{
+          audio_analyzer->process_batch(microphone_buffer.data(), blocks);
+        }
 
-          // Copy the band data to the audio reactive texture
-          band_pixel_buffers[band].peek(audio_reactive_texture_data.data() + band * config.pixels_per_band, config.pixels_per_band);
+        // Onsets and beats still need every block's levels
+        for(int block = 0; block < blocks; block++){
+          audio_features->process_block(audio_analyzer->band_levels_over_channels(block));
         }
 
+        pending_audio.has_new_audio = true;
+        pending_audio.audio_captured = microphone->capture_timestamp();
+
         // MIC DEBUGGING
 
-        if(arg_parser.found("debug-audio")){
-          for(int s=0; s < config.samples_per_pixel; s++){
-              float converted_sample = convertS16LEToFloat(microphone_buffer.data() + 2 * s);
-              memcpy(wav_samples.data() + config.samples_per_pixel * 4 * buffers_written + 4 * s, &converted_sample, 4);
-          }
+        if(debug_audio){
+          copy(audio_analyzer->samples(0), audio_analyzer->samples(0) + blocks * config.samples_per_pixel, wav_samples.data() + config.samples_per_pixel * buffers_written);
 
-          buffers_written ++;
+          buffers_written += blocks;
 
           if(buffers_written == NUM_FRAMES_TO_RECORD_DEBUG){
             drwav_data_format format;
@@ -327,21 +636,37 @@ int main(int argc, char* argv[]){
             drwav_init_file_write(&wav, "test.wav", &format, NULL);
             drwav_write_pcm_frames(&wav, NUM_FRAMES_TO_RECORD_DEBUG * config.samples_per_pixel, wav_samples.data());
 
-            for(int band=0; band<config.num_bands(); band++){
+            for(size_t row=0; row<wav_band_samples.size(); row++){
               drwav band_wav;
-              drwav_init_file_write(&band_wav, ("test_band" + to_string(band) + ".wav").c_str(), &format, NULL);
-              drwav_write_pcm_frames(&band_wav, NUM_FRAMES_TO_RECORD_DEBUG * config.samples_per_pixel, wav_band_samples[band].data());
+              drwav_init_file_write(&band_wav, ("test_band" + to_string(row) + ".wav").c_str(), &format, NULL);
+              drwav_write_pcm_frames(&band_wav, NUM_FRAMES_TO_RECORD_DEBUG * config.samples_per_pixel, wav_band_samples[row].data());
             }
 
-            ws2811_fini(&ledstring);
-            microphone->close();
-            return 0;
+            running = false;
           }
         }
       }
 
+      // The history only has to be laid out for the texture once, however many blocks came in
+      audio_analyzer->update_texture();
+
+      clock_gettime(CLOCK_MONOTONIC, &dsp_end);
+      if(frames_rendered > config.pipeline_depth){
+        audio_allocations += AllocationCounter::allocations_on_this_thread() - audio_allocations_before;
+      }
+
       // Get audio reactive texture into the GPU
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, config.pixels_per_band, config.num_bands(), 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, audio_reactive_texture_data.data());
+      glBindTexture(GL_TEXTURE_2D, audio_reactive_texture);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, audio_analyzer->history(), audio_analyzer->rows(), 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, audio_analyzer->texture());
+
+      // In loopback mode the beat detector firing means this frame is the first to show a click
+      if(click_source && audio_features->beat_since_upload()){
+        pending_audio.shows_click = true;
+        pending_audio.click_captured = click_source->last_click_timestamp();
+      }
+
+      // Per-frame audio features as uniforms
+      audio_features->upload(shaders[current_shader].ID);
     }
 
     // Shader uniforms
@@ -349,37 +674,90 @@ int main(int argc, char* argv[]){
     //cout << "Time: " << (GLfloat) (clock() - clock_start)/CLOCKS_PER_SEC << "\n";
     timespec clock_now;
     clock_gettime(CLOCK_MONOTONIC, &clock_now);
-    glUniform1f(timeLoc, (GLfloat) seconds_elapsed(clock_start, clock_now));
+    float seconds_now = seconds_elapsed(clock_start, clock_now);
+    glUniform1f(timeLoc, (GLfloat) seconds_now);
+
+    if(compositor){
+      compositor->upload(shaders[current_shader].ID, seconds_now);
+    }
 
     // Draw to virtual GBR
 
+    frame_targets.begin_frame();
     glDrawArrays(GL_TRIANGLES, 0, 6);
+    drawn_audio[frame_targets.draw_target()] = pending_audio;
+    pending_audio = DrawnAudio();
+    if(audio_analyzer){
+      copy(audio_analyzer->band_levels().begin(), audio_analyzer->band_levels().end(), drawn_bands[frame_targets.draw_target()].begin());
+    }
 
-    // Copy to buffer
+    // Wait for a free frame while the GPU draws, then copy the oldest finished frame into it
 
-    glReadPixels(0, 0, config.width, config.height, GL_RGB, GL_UNSIGNED_BYTE, led_buffer.data());
+    timespec wait_start, wait_end;
+    clock_gettime(CLOCK_MONOTONIC, &wait_start);
+    int64_t render_wake_latency_ns;
+    LedFrame* frame = frame_queue.acquire_free(&render_wake_latency_ns);
+    if(!frame) break;
+    clock_gettime(CLOCK_MONOTONIC, &wait_end);
+    if(render_wake_latency_ns >= 0){
+      render_wakeup_stats.record(render_wake_latency_ns);
+    }
+
+    if(frame_targets.end_frame(frame->pixels.data(), &frame->render_width, &frame->render_height)){
+      clock_gettime(CLOCK_MONOTONIC, &frame->submitted);
+      frame->brightness = brightness;
+      frame->quality_level = governor ? governor->quality_level() : 0;
+
+      const DrawnAudio& audio = drawn_audio[frame_targets.read_target()];
+      frame->has_new_audio = audio.has_new_audio;
+      frame->audio_captured = audio.audio_captured;
+      frame->shows_click = audio.shows_click;
+      frame->click_captured = audio.click_captured;
+      const vector<float>& bands = drawn_bands[frame_targets.read_target()];
+      copy(bands.begin(), bands.end(), frame->bands.begin());
+      frame_queue.submit(frame);
+    }
+    else{
+      frame_queue.release(frame);
+    }
 
-    // Copy from buffer to LEDs
+    // Waiting on the strip isn't work, only what's left counts against the budget
 
-    for(int y = 0; y < config.height; y++){
-      for(int x = 0; x < config.width; x++){
-        char* pixel = &led_buffer[(y * config.width + x) * 3];
-        
-        // Convert a pixel e.g. 0xRRGGBB into 0x00BBGGRR
-        ledstring.channel[0].leds[y * config.width + x] = (pixel[2] << 16) | (pixel[1] << 8) | pixel[0];
+    if(governor){
+      timespec loop_end;
+      clock_gettime(CLOCK_MONOTONIC, &loop_end);
+      float work_seconds = seconds_elapsed(loop_start, loop_end) - seconds_elapsed(wait_start, wait_end);
+      if(governor->update(work_seconds, seconds_elapsed(dsp_start, dsp_end))){
+        apply_quality();
       }
     }
 
-    if((ret = ws2811_render(&ledstring)) != WS2811_SUCCESS){
-      cerr << "ws2811_render failed: " << ws2811_get_return_t_str(ret) << "\n";
-      break;
+    // Report heap allocations in steady state, both numbers should stay at 0
+
+    if(debug_allocations && ++frames_rendered > config.pipeline_depth){
+      loop_allocations += AllocationCounter::allocations_on_this_thread() - loop_allocations_before;
+      frames_counted++;
+
+      if(seconds_elapsed(last_allocation_report, loop_start) >= JITTER_REPORT_SECONDS){
+        cout << "Heap allocations over " << frames_counted << " frames: " << audio_allocations << " in audio processing, "
+          << loop_allocations << " in the whole render loop\n";
+        audio_allocations = loop_allocations = 0;
+        frames_counted = 0;
+        last_allocation_report = loop_start;
+      }
     }
 
     // 15 frames / s  (NOT how frame timing works ...)
     //usleep(1000000 / 15);
   }
 
-  ws2811_fini(&ledstring);
+  frame_queue.close();
+  led_output_thread.join();
+  if(output_ret != WS2811_SUCCESS) ret = output_ret;
+
+  if(!loopback){
+    ws2811_fini(&ledstring);
+  }
 
   if(microphone){
     microphone->close();
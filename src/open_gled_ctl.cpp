@@ -0,0 +1,98 @@
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "args.h"
+
+#include "ControlPlane.h"
+
+using namespace std;
+
+void print_parameters(const ControlParameters& params){
+  cout << "brightness: " << params.brightness << "\n";
+  cout << "shader: " << params.shader << "\n";
+  cout << "pregain: " << params.pregain << "\n";
+  cout << "bands:";
+  for(int i = 0; i < params.num_band_cutoffs; i++){
+    cout << (i == 0 ? " " : ",") << params.band_cutoffs[i];
+  }
+  cout << "\n";
+  cout << "sample rate: " << params.sample_rate << "\n";
+}
+
+int main(int argc, char* argv[]){
+
+  args::ArgParser arg_parser("Usage: open_gled_ctl [--segment NAME] [--brightness 0-255] [--shader INDEX] [--pregain GAIN] [--bands F0,F1,...]\n"
+                             "Changes parameters of a running open_gled, prints them if nothing is set.", "1.0");
+  arg_parser.option("segment", "/open_gled_control");
+  arg_parser.option("brightness");
+  arg_parser.option("shader");
+  arg_parser.option("pregain");
+  arg_parser.option("bands");
+
+  arg_parser.parse(argc, argv);
+
+  ControlPlane control(arg_parser.value("segment"), false);
+  if(!control.Initialize()){
+    cerr << "Is open_gled running with CONTROL_SETTINGS in its config?\n";
+    return 1;
+  }
+
+  ControlParameters params = control.read();
+  bool changed = false;
+
+  try{
+    if(arg_parser.found("brightness")){
+      params.brightness = stoi(arg_parser.value("brightness"));
+      changed = true;
+    }
+    if(arg_parser.found("shader")){
+      params.shader = stoi(arg_parser.value("shader"));
+      changed = true;
+    }
+    if(arg_parser.found("pregain")){
+      params.pregain = stof(arg_parser.value("pregain"));
+      if(!ControlPlane::ValidPregain(params.pregain)){
+        cerr << "Pregain needs to be a number >= 0\n";
+        return 1;
+      }
+      changed = true;
+    }
+    if(arg_parser.found("bands")){
+      // Has to be the same number of bands the renderer started with
+      stringstream cutoffs(arg_parser.value("bands"));
+      string cutoff;
+      int count = 0;
+      float new_cutoffs[CONTROL_MAX_BANDS + 1];
+      while(getline(cutoffs, cutoff, ',') && count <= CONTROL_MAX_BANDS){
+        new_cutoffs[count++] = stof(cutoff);
+      }
+      if(count != params.num_band_cutoffs){
+        cerr << "Expected " << params.num_band_cutoffs << " band cutoffs, got " << count << "\n";
+        return 1;
+      }
+      string error;
+      if(!ControlPlane::ValidBandCutoffs(new_cutoffs, count, params.sample_rate, &error)){
+        cerr << "Invalid band cutoffs: " << error << "\n";
+        return 1;
+      }
+      copy(new_cutoffs, new_cutoffs + count, params.band_cutoffs);
+      changed = true;
+    }
+  }
+  catch(logic_error& e){
+    cerr << "Invalid value: " << e.what() << "\n";
+    return 1;
+  }
+
+  if(changed){
+    control.publish(params);
+  }
+  else{
+    print_parameters(params);
+  }
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "args.h"
+
+#include "FrameExport.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]){
+
+  args::ArgParser arg_parser("Usage: open_gled_frames [--segment NAME] [--raw]\n"
+                             "Prints stats about the frames a running open_gled sends to the LEDs every second.\n"
+                             "With --raw, writes every frame to stdout as RGB24 instead, e.g. for\n"
+                             "  open_gled_frames --raw | ffmpeg -f rawvideo -pix_fmt rgb24 -video_size 144x1 -framerate 60 -i - out.mkv", "1.0");
+  arg_parser.option("segment", "/open_gled_frames");
+  arg_parser.flag("raw");
+
+  arg_parser.parse(argc, argv);
+  bool raw = arg_parser.found("raw");
+
+  FrameExport frames(arg_parser.value("segment"));
+  if(!frames.Initialize()){
+    cerr << "Is open_gled running with FRAME_EXPORT_SETTINGS in its config?\n";
+    return 1;
+  }
+
+  const FrameExportHeader* header = frames.header();
+  int num_leds = header->width * header->height;
+  cerr << "Reading " << header->width << "x" << header->height << " frames with " << header->num_bands << " bands\n";
+
+  vector<unsigned char> rgb(num_leds * 3), previous_rgb(num_leds * 3);
+  uint64_t last_seen = header->frames_written.load(memory_order_acquire);
+  uint64_t received = 0, dropped = 0, torn = 0;
+  const uint32_t MAX_BANDS = 64;
+  float band_sums[MAX_BANDS] = {};
+  float frame_bands[MAX_BANDS];
+  uint32_t num_bands = min(header->num_bands, MAX_BANDS);
+  double brightness_sum = 0;
+  uint32_t quality_level = 0;
+
+  timespec last_report;
+  clock_gettime(CLOCK_MONOTONIC, &last_report);
+
+  while(true){
+    uint64_t written = header->frames_written.load(memory_order_acquire);
+
+    if(written == last_seen){
+      usleep(1000);
+    }
+
+    // Anything older than a full ring has already been overwritten
+    if(written - last_seen > header->slot_count){
+      dropped += written - last_seen - header->slot_count;
+      last_seen = written - header->slot_count;
+    }
+
+    for(; last_seen < written; last_seen++){
+      const FrameExportSlot* slot = frames.slot(last_seen);
+      uint64_t sequence = FrameExport::begin_read(slot);
+
+      // Read straight out of shared memory, then check the renderer didn't lap us while we did
+      const uint32_t* leds = frames.leds(slot);
+      double frame_brightness = 0;
+      uint64_t frame_number = slot->frame_number;
+      uint32_t frame_quality_level = slot->quality_level;
+      copy(frames.bands(slot), frames.bands(slot) + num_bands, frame_bands);
+      if(raw){
+        for(int i = 0; i < num_leds; i++){
+          // 0x00BBGGRR -> R, G, B
+          rgb[i * 3] = leds[i] & 0xFF;
+          rgb[i * 3 + 1] = (leds[i] >> 8) & 0xFF;
+          rgb[i * 3 + 2] = (leds[i] >> 16) & 0xFF;
+        }
+      }
+      else{
+        uint64_t total = 0;
+        for(int i = 0; i < num_leds; i++){
+          total += (leds[i] & 0xFF) + ((leds[i] >> 8) & 0xFF) + ((leds[i] >> 16) & 0xFF);
+        }
+        frame_brightness = (double) total / (num_leds * 3 * 255);
+      }
+
+      // A torn frame is gone for good, the renderer already overwrote it. Raw output repeats the
+      // previous frame instead so the stream keeps one frame per frame sent and its timing holds.
+      if(!FrameExport::end_read(slot, sequence) || frame_number != last_seen){
+        torn++;
+        if(raw){
+          fwrite(previous_rgb.data(), 1, previous_rgb.size(), stdout);
+        }
+        continue;
+      }
+
+      received++;
+      quality_level = frame_quality_level;
+      if(raw){
+        fwrite(rgb.data(), 1, rgb.size(), stdout);
+        swap(rgb, previous_rgb);
+      }
+      else{
+        brightness_sum += frame_brightness;
+        for(uint32_t b = 0; b < num_bands; b++){
+          band_sums[b] += frame_bands[b];
+        }
+      }
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(now.tv_sec - last_report.tv_sec >= 1){
+      double seconds = (now.tv_sec - last_report.tv_sec) + (now.tv_nsec - last_report.tv_nsec) / 1e9;
+      cerr << received / seconds << " fps, " << dropped << " dropped, " << torn << " torn";
+      if(!raw && received > 0){
+        cerr << ", average LED level " << brightness_sum / received << ", bands";
+        for(uint32_t b = 0; b < num_bands; b++){
+          cerr << " " << band_sums[b] / received;
+          band_sums[b] = 0;
+        }
+        brightness_sum = 0;
+      }
+      if(received > 0){
+        cerr << ", quality level " << quality_level;
+      }
+      cerr << "\n";
+
+      received = dropped = torn = 0;
+      last_report = now;
+    }
+  }
+
+  return 0;
+}
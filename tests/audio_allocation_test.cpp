@@ -0,0 +1,127 @@
+// Checks that audio analysis doesn't touch the heap once it's running: batches of 1 to
+// MAX_BACKLOG_BLOCKS blocks go through AudioAnalyzer and AudioFeatureExtractor the same way the
+// render loop drives them, and after a warm-up pass every allocation is counted by
+// AllocationCounter. Needs no GL context or audio hardware.
+
+#include <iostream>
+#include <new>
+#include <vector>
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "AllocationCounter.h"
+#include "AudioAnalyzer.h"
+#include "AudioFeatures.h"
+#include "OpenGLEDConfig.h"
+
+using namespace std;
+
+const int ROUNDS = 20;
+
+// Fills blocks of S16 audio: a sine per channel plus a short click every 21 blocks, so onsets,
+// beats and the tempo estimate all get exercised
+void synthesize(vector<int16_t>& pcm, const OpenGLEDConfig& config, int blocks, long& block_counter){
+  for(int block = 0; block < blocks; block++, block_counter++){
+    for(int s = 0; s < config.samples_per_pixel; s++){
+      long t = block_counter * config.samples_per_pixel + s;
+      bool click = block_counter % 21 == 0 && s < config.samples_per_pixel / 4;
+      for(int c = 0; c < config.channels; c++){
+        float value = 0.2f * sin(t * 0.01f * (c + 1)) + (click ? 0.7f * sin(t * 0.015f) : 0.f);
+        pcm[(block * config.samples_per_pixel + s) * config.channels + c] = (int16_t) (value * 32767);
+      }
+    }
+  }
+}
+
+// Returns the allocations made after warming up, while running every batch size ROUNDS times
+unsigned long count_steady_state_allocations(OpenGLEDConfig config){
+  AudioAnalyzer analyzer(config);
+  AudioFeatureExtractor features(config);
+  vector<int16_t> pcm(config.samples_per_pixel * config.channels * config.max_backlog_blocks);
+  long block_counter = 0;
+
+  auto run_batch = [&](int blocks){
+    synthesize(pcm, config, blocks, block_counter);
+    analyzer.process_batch((const char*) pcm.data(), blocks);
+    for(int block = 0; block < blocks; block++){
+      features.process_block(analyzer.band_levels_over_channels(block));
+    }
+    analyzer.update_texture();
+  };
+
+  // Warm-up, so anything lazily set up on first use doesn't count
+  for(int blocks = 1; blocks <= config.max_backlog_blocks; blocks++){
+    run_batch(blocks);
+  }
+
+  unsigned long before = AllocationCounter::allocations_on_this_thread();
+  for(int round = 0; round < ROUNDS; round++){
+    // The quality governor's cheaper modes switch on and off while running too
+    analyzer.set_decimation(round % 4 == 2);
+    analyzer.set_history_length(round % 2 ? config.pixels_per_band / 2 : config.pixels_per_band);
+
+    for(int blocks = 1; blocks <= config.max_backlog_blocks; blocks++){
+      run_batch(blocks);
+    }
+  }
+  return AllocationCounter::allocations_on_this_thread() - before;
+}
+
+int main(){
+
+  if(!AllocationCounter::enabled()){
+    cerr << "Built without OPENGLED_COUNT_ALLOCATIONS, nothing would be counted.\n";
+    return 1;
+  }
+
+  // Make sure the hook actually sees allocations, in every form the code could make them.
+  // The pointers are volatile, or the compiler may leave out the allocate/free pairs.
+  struct alignas(64) CacheLine { float values[16]; };
+  unsigned long before = AllocationCounter::allocations_on_this_thread();
+  int* volatile probe = new int(0);
+  delete probe;
+  int* volatile nothrow_probe = new (nothrow) int(0);
+  delete nothrow_probe;
+  CacheLine* volatile aligned_probe = new CacheLine();
+  delete aligned_probe;
+  unsigned long expected = 3;
+#ifdef OPENGLED_WRAP_MALLOC
+  void* volatile malloc_probe = malloc(16);
+  free(malloc_probe);
+  expected++;
+#endif
+  unsigned long counted = AllocationCounter::allocations_on_this_thread() - before;
+  if(counted != expected){
+    cerr << "AllocationCounter counted " << counted << " of " << expected << " test allocations.\n";
+    return 1;
+  }
+
+  OpenGLEDConfig config;
+  config.frequency_bands = { 20, 250, 1000, 4000, 20000 };
+  config.sample_rate = 44100;
+  config.samples_per_pixel = 512;
+  config.pixels_per_band = 144;
+  config.max_backlog_blocks = 8;
+
+  struct Case { const char* name; int channels; ChannelMix mix; };
+  const Case cases[] = {
+    { "mono", 1, ChannelMix::Separate },
+    { "stereo separate", 2, ChannelMix::Separate },
+    { "stereo mid", 2, ChannelMix::Mid },
+    { "stereo mid_side", 2, ChannelMix::MidSide },
+    { "3 channels separate", 3, ChannelMix::Separate },
+  };
+
+  int failures = 0;
+  for(const Case& test : cases){
+    config.channels = test.channels;
+    config.channel_mix = test.mix;
+
+    unsigned long allocations = count_steady_state_allocations(config);
+    cout << test.name << ": " << allocations << " allocations in steady state\n";
+    if(allocations != 0) failures++;
+  }
+
+  return failures == 0 ? 0 : 1;
+}